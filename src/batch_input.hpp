@@ -0,0 +1,92 @@
+#pragma once
+#include <poll.h>
+#include "bookstore.hpp"
+#include "spsc_ring.hpp"
+
+// Pipelined input for replaying large command files (code --batch). A
+// reader thread pulls the input in 1 MiB chunks, splits it into lines and
+// parses each one into a ring slot; the calling thread executes the slots
+// strictly in order, so reading and tokenizing overlap with execution
+// instead of adding to it. Output goes through ctx.out as usual.
+class BatchInput {
+  public:
+    explicit BatchInput(int fd) : fd(fd), reader([this] { readAll(); }) {}
+    ~BatchInput() {
+        stop.store(true, std::memory_order_relaxed);
+        reader.join();
+    }
+    BatchInput(const BatchInput &) = delete;
+    BatchInput &operator=(const BatchInput &) = delete;
+
+    // Runs every command until end of input or quit / exit.
+    void run(Context &ctx) {
+        Backoff backoff;
+        while (ctx.running) {
+            ParsedCommand *cmd = ring.front();
+            if (!cmd) {
+                if (ring.drained()) break;
+                backoff.pause();
+                continue;
+            }
+            backoff.reset();
+            execute(ctx, *cmd);
+            ring.release();
+        }
+    }
+
+  private:
+    static constexpr size_t kChunk = 1 << 20;
+
+    void readAll() {
+        unique_ptr<char[]> buf(new char[kChunk]);
+        string partial; // a line split across chunks
+        for (ssize_t n; waitReadable() && (n = ::read(fd, buf.get(), kChunk)) != 0;) {
+            if (n < 0) { if (errno == EINTR) continue; break; }
+            const char *p = buf.get(), *end = p + n;
+            for (const char *nl; (nl = static_cast<const char *>(memchr(p, '\n', size_t(end - p))));) {
+                if (partial.empty()) {
+                    if (!push(string_view(p, size_t(nl - p)))) return ring.close();
+                } else {
+                    partial.append(p, nl);
+                    if (!push(partial)) return ring.close();
+                    partial.clear();
+                }
+                p = nl + 1;
+            }
+            partial.append(p, end);
+        }
+        if (!partial.empty()) push(partial); // last line without a newline
+        ring.close();
+    }
+
+    // Parses one line into the next free slot; false once the consumer quit.
+    bool push(string_view line) {
+        Backoff backoff;
+        ParsedCommand *slot;
+        while (!(slot = ring.claim())) {
+            if (stop.load(std::memory_order_relaxed)) return false;
+            backoff.pause();
+        }
+        slot->line.assign(line);
+        parse(*slot);
+        ring.publish();
+        return true;
+    }
+
+    // Blocks until fd has data, in short polls so that a quit read from an
+    // interactive stream does not leave the thread stuck in read().
+    bool waitReadable() {
+        pollfd p{fd, POLLIN, 0};
+        while (!stop.load(std::memory_order_relaxed)) {
+            int r = ::poll(&p, 1, 50);
+            if (r > 0) return true;
+            if (r < 0 && errno != EINTR) return true; // let read() report it
+        }
+        return false;
+    }
+
+    int fd;
+    SpscRing<ParsedCommand, 1024> ring;
+    std::atomic<bool> stop{false};
+    thread reader; // last: starts once the ring exists
+};
@@ -0,0 +1,272 @@
+// Benchmark driver. Creates a synthetic user base and catalogue, then runs
+// a seeded command mix against the engine in-process and reports
+// throughput, per-command latency, peak RSS, bytes written and the number
+// of data files, for comparison with the judge limits (10 s, 64 MiB, 20
+// files per test case).
+//
+//   bench [--mix read|buy|import|nest|mixed] [--ops N] [--users N]
+//         [--books N] [--seed N] [--dir PATH]
+//
+// Without --dir the run uses a fresh directory under /tmp and removes it
+// afterwards.
+#include "bookstore.hpp"
+#include "histogram.hpp"
+#include <sys/resource.h>
+
+namespace {
+
+struct Options {
+    string mix = "mixed";
+    long long ops = 200000;
+    long long users = 10000;
+    long long books = 20000;
+    unsigned long long seed = 1;
+    string dir;
+};
+
+// Seeded generator of command lines. It tracks the login stack and the
+// selections on it, so that most of what it emits is legal for the account
+// on top, as it would be for real clients.
+class Workload {
+  public:
+    explicit Workload(const Options &opt) : rng(opt.seed), users(max(opt.users, 1LL)), books(max(opt.books, 1LL)) {}
+
+    // Commands creating the accounts and the catalogue, run as root.
+    template <class F>
+    void setup(F &&emit) {
+        emit("su root sjtu");
+        stack.push_back({7, -1});
+        for (long long u = 0; u < users; ++u)
+            emit("useradd " + userId(u) + " pw " + to_string(privilegeOf(u)) + " user" + to_string(u));
+        for (long long b = 0; b < books; ++b) {
+            emit("select " + isbn(b));
+            emit("modify -name=\"" + name(b) + "\" -author=\"" + author(b) + "\" -keyword=\"" + keyword(b) + "\" -price=" + price());
+            emit("import " + to_string(pick(50, 500)) + " " + price());
+        }
+    }
+
+    string next(const string &mix) {
+        if (mix == "read") return readHeavy();
+        if (mix == "buy") return buyHeavy();
+        if (mix == "import") return importHeavy();
+        if (mix == "nest") return nested();
+        switch (pick(0, 3)) {
+            case 0: return readHeavy();
+            case 1: return buyHeavy();
+            case 2: return importHeavy();
+            default: return nested();
+        }
+    }
+
+    size_t depth() const { return stack.size(); }
+
+  private:
+    struct Login { int privilege; long long selected; };
+
+    string readHeavy() {
+        double r = coin();
+        if (r < 0.30) return "show -ISBN=" + isbn(anyBook());
+        if (r < 0.50) return "show -name=\"" + name(anyBook()) + "\"";
+        if (r < 0.65) return "show -author=\"" + author(anyBook()) + "\"";
+        if (r < 0.80) return "show -keyword=kw" + to_string(pick(0, kKeywords - 1));
+        if (r < 0.8005) return "show";
+        if (r < 0.90) return buy();
+        if (r < 0.95) return su(pick(0, users - 1));
+        return logout();
+    }
+
+    string buyHeavy() {
+        double r = coin();
+        if (r < 0.60) return buy();
+        if (r < 0.80) return "show -ISBN=" + isbn(anyBook());
+        if (r < 0.90) return top().privilege == 7 ? "show finance " + to_string(pick(1, 100)) : buy();
+        if (r < 0.95) return su(pick(0, users - 1));
+        return logout();
+    }
+
+    // Runs as staff: climbs back down to a privileged account first.
+    string importHeavy() {
+        if (top().privilege < 3) return logout();
+        double r = coin();
+        if (r < 0.25 || top().selected < 0) return select(anyBook());
+        if (r < 0.55) {
+            long long b = top().selected;
+            switch (pick(0, 2)) {
+                case 0: return "modify -price=" + price();
+                case 1: return "modify -name=\"" + name(pick(0, books - 1)) + "\" -price=" + price();
+                default: return "modify -keyword=\"" + keyword(b + pick(1, 7)) + "\"";
+            }
+        }
+        if (r < 0.85) return "import " + to_string(pick(1, 100)) + " " + price();
+        return "show -ISBN=" + isbn(top().selected);
+    }
+
+    // Long su chains: logins outnumber logouts, so the stack keeps growing.
+    string nested() {
+        double r = coin();
+        if (r < 0.45) return su(pick(0, users - 1));
+        if (r < 0.85) return logout();
+        if (r < 0.92 && top().privilege >= 3) return select(anyBook());
+        return buy();
+    }
+
+    string su(long long u) {
+        int priv = privilegeOf(u);
+        bool omit = top().privilege > priv && coin() < 0.5;
+        stack.push_back({priv, -1});
+        return "su " + userId(u) + (omit ? "" : " pw");
+    }
+    string logout() {
+        if (stack.size() <= 1) return "show -ISBN=" + isbn(anyBook()); // keep root logged in
+        stack.pop_back();
+        return "logout";
+    }
+    string select(long long b) {
+        top().selected = b;
+        return "select " + isbn(b);
+    }
+    string buy() { return "buy " + isbn(anyBook()) + " " + to_string(pick(1, 3)); }
+
+    Login &top() { return stack.back(); }
+
+    // Popular books are picked more often: half the picks hit the first 10%.
+    long long anyBook() { return coin() < 0.5 ? pick(0, max(books / 10, 1LL) - 1) : pick(0, books - 1); }
+
+    static constexpr long long kKeywords = 1000;
+    static string userId(long long u) { return "u" + to_string(u); }
+    static int privilegeOf(long long u) { return u % 5 == 0 ? 3 : 1; }
+    static string isbn(long long b) { return "978-" + to_string(1000000 + b); }
+    static string name(long long b) { return "Title " + to_string(b / 4); }
+    static string author(long long b) { return "Author " + to_string(b % 997); }
+    static string keyword(long long b) {
+        long long a = b % kKeywords, c = (b * 7 + 3) % kKeywords;
+        if (c == a) c = (c + 1) % kKeywords;
+        return "kw" + to_string(a) + "|kw" + to_string(c);
+    }
+    string price() { return to_string(pick(1, 200)) + "." + to_string(pick(10, 99)); }
+
+    long long pick(long long lo, long long hi) { return uniform_int_distribution<long long>(lo, hi)(rng); }
+    double coin() { return uniform_real_distribution<double>(0, 1)(rng); }
+
+    mt19937_64 rng;
+    long long users, books;
+    vector<Login> stack;
+};
+
+// Command label for latency reporting: the keyword, plus the filter for show.
+string labelOf(const string &line) {
+    size_t sp = line.find(' ');
+    string cmd = line.substr(0, sp);
+    if (cmd != "show" || sp == string::npos) return cmd;
+    string arg = line.substr(sp + 1);
+    return "show " + arg.substr(0, arg.find_first_of("= "));
+}
+
+uint64_t bytesWrittenBySelf() {
+    ifstream io("/proc/self/io");
+    string key; uint64_t v;
+    while (io >> key >> v)
+        if (key == "wchar:") return v;
+    return 0;
+}
+
+double seconds(chrono::steady_clock::duration d) { return chrono::duration<double>(d).count(); }
+
+bool parse(int argc, char **argv, Options &opt) {
+    for (int i = 1; i < argc; ++i) {
+        string a = argv[i];
+        if (i + 1 >= argc) return false;
+        string v = argv[++i];
+        if (a == "--mix") opt.mix = v;
+        else if (a == "--ops") opt.ops = atoll(v.c_str());
+        else if (a == "--users") opt.users = atoll(v.c_str());
+        else if (a == "--books") opt.books = atoll(v.c_str());
+        else if (a == "--seed") opt.seed = strtoull(v.c_str(), nullptr, 10);
+        else if (a == "--dir") opt.dir = v;
+        else return false;
+    }
+    static const set<string> mixes = {"read", "buy", "import", "nest", "mixed"};
+    return mixes.count(opt.mix) && opt.ops >= 0;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+    Options opt;
+    if (!parse(argc, argv, opt)) {
+        cerr << "usage: bench [--mix read|buy|import|nest|mixed] [--ops N] [--users N] [--books N] [--seed N] [--dir PATH]\n";
+        return 2;
+    }
+    bool scratch = opt.dir.empty();
+    if (scratch) {
+        char tmpl[] = "/tmp/bookstore-bench-XXXXXX";
+        if (!mkdtemp(tmpl)) { perror("mkdtemp"); return 1; }
+        opt.dir = tmpl;
+    }
+    filesystem::create_directories(opt.dir);
+    if (chdir(opt.dir.c_str()) != 0) { perror("chdir"); return 1; }
+
+    using Clock = chrono::steady_clock;
+    Workload work(opt);
+    map<string, LatencyHistogram> latency;
+    Clock::duration setupTime{}, runTime{}, closeTime{};
+    uint64_t outputBytes = 0, before = bytesWrittenBySelf();
+    long long setupOps = 0;
+    uint64_t catalogue = 0, accounts = 0;
+    {
+        int devnull = ::open("/dev/null", O_WRONLY);
+        auto t0 = Clock::now();
+        auto adb = make_unique<AccountDB>(); auto bdb = make_unique<BookDB>();
+        auto fdb = make_unique<FinanceDB>(); auto journal = make_unique<JournalDB>(*fdb);
+        Session session;
+        OutputBuffer out(devnull);
+        Context ctx{*adb, *bdb, *fdb, *journal, session, out};
+
+        work.setup([&](string line) { execute(ctx, line); ++setupOps; });
+        auto t1 = Clock::now();
+        setupTime = t1 - t0;
+        for (long long i = 0; i < opt.ops; ++i) {
+            string line = work.next(opt.mix);
+            LatencyHistogram &h = latency[labelOf(line)];
+            auto s = Clock::now();
+            execute(ctx, line);
+            h.add(uint64_t(chrono::duration_cast<chrono::nanoseconds>(Clock::now() - s).count()));
+        }
+        auto t2 = Clock::now();
+        runTime = t2 - t1;
+        catalogue = bdb->size(); accounts = adb->size();
+        out.flush();
+        outputBytes = out.bytesWritten();
+        storage::durability().syncAll();
+        journal.reset(); fdb.reset(); bdb.reset(); adb.reset(); // checkpoints
+        closeTime = Clock::now() - t2;
+        ::close(devnull);
+    }
+    uint64_t written = bytesWrittenBySelf() - before - outputBytes;
+
+    long long files = 0;
+    for (auto &e : filesystem::directory_iterator(storage::kDataDir))
+        if (e.is_regular_file()) ++files;
+    rusage ru{};
+    getrusage(RUSAGE_SELF, &ru);
+
+    printf("mix %s, seed %llu: %lld users, %lld books, %lld ops\n", opt.mix.c_str(), opt.seed, opt.users, opt.books, opt.ops);
+    printf("setup   %8.3f s  (%lld commands)\n", seconds(setupTime), setupOps);
+    printf("run     %8.3f s  %.0f ops/s\n", seconds(runTime), opt.ops / max(seconds(runTime), 1e-9));
+    printf("close   %8.3f s\n", seconds(closeTime));
+    printf("\n%-16s %10s %10s %10s %10s\n", "command", "count", "p50 us", "p99 us", "max us");
+    for (auto &[label, h] : latency)
+        printf("%-16s %10llu %10.1f %10.1f %10.1f\n", label.c_str(), (unsigned long long)h.count(),
+               h.percentile(50) / 1e3, h.percentile(99) / 1e3, h.max() / 1e3);
+    printf("\npeak RSS    %8.1f MiB (limit 64)\n", ru.ru_maxrss / 1024.0);
+    printf("written     %8.1f MiB\n", written / 1048576.0);
+    printf("data files  %8lld (limit 20)\n", files);
+    printf("stored      %8llu books, %llu accounts\n", (unsigned long long)catalogue, (unsigned long long)accounts);
+    printf("final login depth %zu\n", work.depth());
+
+    if (scratch) {
+        if (chdir("/") != 0) return 1;
+        filesystem::remove_all(opt.dir);
+    }
+    return 0;
+}
@@ -0,0 +1,1449 @@
+#pragma once
+// The bookstore engine: storage-backed tables, validators and command
+// handlers. main.cpp feeds it stdin; tools such as the benchmark drive it
+// in-process through execute().
+#include <bits/stdc++.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "bptree.hpp"
+#include "durability.hpp"
+#include "fixed_string.hpp"
+#include "money.hpp"
+#include "output_buffer.hpp"
+#include "stats.hpp"
+using namespace std;
+
+// Persistent storage helpers
+namespace storage {
+    static const string kDataDir = ".data";
+
+    inline void ensureDataDir() {
+        static bool ensured = false;
+        if (ensured) return;
+        std::error_code ec;
+        std::filesystem::create_directories(kDataDir, ec);
+        ensured = true;
+    }
+
+    inline string path(const string &name) {
+        ensureDataDir();
+        return kDataDir + string("/") + name;
+    }
+
+    // The tablespace every table lives in (bookstore.db, logged to
+    // bookstore.log): opened by the first table and checkpointed and closed
+    // once the last one has closed.
+    inline shared_ptr<Tablespace> tablespace() {
+        static weak_ptr<Tablespace> open;
+        if (auto space = open.lock()) return space;
+        auto space = make_shared<Tablespace>(path("bookstore.db"), path("bookstore.log"));
+        open = space;
+        return space;
+    }
+}
+
+// Every field is bounded by the spec, so both records are fixed-size and
+// allocation-free, like their on-disk counterparts.
+struct Account {
+    storage::FixedString<30> userId;
+    storage::FixedString<30> password;
+    int privilege = 1;
+    storage::FixedString<30> username;
+};
+
+struct Book {
+    storage::FixedString<20> isbn;
+    storage::FixedString<60> name;
+    storage::FixedString<60> author;
+    storage::FixedString<60> keyword;
+    long long stock = 0;
+    Money price;
+};
+
+// Permanent internal ID of a book; the ISBN can change, this cannot.
+using BookId = uint32_t;
+constexpr BookId kNoBook = 0;
+
+// Read-only view of one stored book, handed to the BookDB visitors. The views
+// point into cached pages and are only valid inside the callback.
+struct BookRow {
+    BookId id;
+    string_view isbn;
+    string_view name;
+    string_view author;
+    string_view keyword;
+    long long stock;
+    Money price;
+};
+
+// Account database: B+ tree keyed by UserID in the "accounts" segment. Every
+// mutation is logged before it touches the tree. A password change
+// logs and patches just that field of the record, in place on its leaf.
+class AccountDB {
+  public:
+    AccountDB() : segment(storage::tablespace(), "accounts"), tree(segment, 0) {
+        segment.replay([&](string_view op) { apply(op); });
+        // init root if missing
+        if (!exists("root")) { add(Account{"root", "sjtu", 7, "root"}); segment.endCommand(); }
+    }
+
+    bool exists(string_view uid) const { return uid.size() <= kIdLen && tree.find(Key(uid)); }
+    uint64_t size() const { return tree.size(); }
+
+    optional<Account> get(string_view uid) const {
+        Record r;
+        if (uid.size() > kIdLen || !tree.find(Key(uid), &r)) return nullopt;
+        return Account{Key(uid), r.password, r.privilege, r.username};
+    }
+
+    bool add(const Account &a) {
+        if (exists(a.userId.view())) return false;
+        commit(PutOp{kPut, a.userId, encode(a)});
+        return true;
+    }
+
+    bool remove(string_view uid) {
+        if (!exists(uid)) return false;
+        commit(EraseOp{kErase, Key(uid)});
+        return true;
+    }
+
+    bool updatePassword(string_view uid, string_view pw) {
+        if (!exists(uid)) return false;
+        commit(PasswordOp{kPassword, Key(uid), Password(pw)});
+        return true;
+    }
+
+    // Visits every account in ascending UserID order.
+    template <class F>
+    void forEach(F &&visit) const {
+        for (auto c = tree.begin(); c.valid(); c.next()) {
+            const Record &r = c.value();
+            visit(Account{c.key(), r.password, r.privilege, r.username});
+        }
+    }
+
+    // Replaces every account with those scan(add) passes to add, in strictly
+    // ascending UserID order: the tree is built bottom-up with full pages and
+    // nothing is logged. Checkpoints when done.
+    template <class F>
+    void bulkLoad(F &&scan) {
+        tree.rebuild(1.0, [&](auto &&add) {
+            scan([&](const Account &a) {
+                add(a.userId, encode(a));
+                segment.maybeCheckpoint();
+            });
+        });
+        segment.checkpoint();
+    }
+
+  private:
+    static constexpr size_t kIdLen = 30;
+    using Key = storage::FixedString<kIdLen>;
+    using Password = storage::FixedString<30>;
+    struct Record {
+        Password password;
+        storage::FixedString<30> username;
+        int32_t privilege;
+    };
+
+    // redo log records
+    enum : uint8_t { kPut = 1, kErase = 2, kPassword = 3 };
+    struct PutOp { uint8_t op; Key key; Record rec; };
+    struct EraseOp { uint8_t op; Key key; };
+    struct PasswordOp { uint8_t op; Key key; Password password; };
+
+    template <class Op>
+    void commit(const Op &op) {
+        segment.logOp(&op, sizeof op);
+        apply(string_view(reinterpret_cast<const char *>(&op), sizeof op));
+    }
+
+    void apply(string_view op) {
+        if (op.empty()) return;
+        if (op[0] == kPut && op.size() == sizeof(PutOp)) {
+            PutOp o; memcpy(&o, op.data(), sizeof o);
+            if (!tree.assign(o.key, o.rec)) tree.insert(o.key, o.rec);
+        } else if (op[0] == kErase && op.size() == sizeof(EraseOp)) {
+            EraseOp o; memcpy(&o, op.data(), sizeof o);
+            tree.erase(o.key);
+        } else if (op[0] == kPassword && op.size() == sizeof(PasswordOp)) {
+            PasswordOp o; memcpy(&o, op.data(), sizeof o);
+            tree.modify(o.key, [&](Record &r) { r.password = o.password; });
+        }
+    }
+
+    static Record encode(const Account &a) {
+        return Record{a.password, a.username, a.privilege};
+    }
+
+    storage::Segment segment;
+    storage::BPlusTree<Key, Record> tree;
+};
+
+// Book database, in the "books" segment of the tablespace. Every book gets
+// a permanent ID when it is created; the records live in a B+ tree keyed by
+// that ID, and the ISBN is a secondary key like the others:
+//   slot 0  ID -> record (ISBN included)
+//   slot 1  ISBN -> ID
+//   slot 2  (name, ISBN) -> ID
+//   slot 3  (author code, ISBN) -> ID
+//   slot 4  (keyword segment code, ISBN) -> ID
+//   slot 5  text -> code
+//   slot 6  code -> text
+// Authors and keywords repeat across many books, so they are interned: a
+// record holds the code of its author and of its whole keyword string, the
+// author and keyword indexes are keyed by codes, and a filter that names an
+// unknown text is answered without touching them. Codes are dense from 1
+// (0 is the empty string) and are never freed; interning a text is its own
+// log record, written before the first record that uses it. The first
+// kMirrored texts are also kept in memory for decoding.
+//
+// The secondary indexes are kept in step by apply(), so replaying the log
+// rebuilds them too; as they are ordered by ISBN within equal text, every
+// listing comes out in ISBN order. Changing the ISBN moves index keys only,
+// and sessions holding the ID keep pointing at the book. Stock changes log
+// only the delta and patch the stock field in place.
+//
+// Books are never deleted, so IDs are dense: 1 .. size().
+class BookDB {
+  public:
+    BookDB()
+        : segment(storage::tablespace(), "books"), tree(segment, 0),
+          byIsbn(segment, 1), byName(segment, 2), byAuthor(segment, 3), byKeyword(segment, 4), codes(segment, 5), texts(segment, 6) {
+        for (auto c = texts.begin(); c.valid() && c.key() < kMirrored; c.next()) mirror(c.key(), c.value());
+        segment.replay([&](string_view op) { apply(op); });
+    }
+
+    // ID of the book with this ISBN, or kNoBook.
+    BookId idOf(string_view isbn) const {
+        BookId id = kNoBook;
+        if (isbn.size() <= kIsbnLen) byIsbn.find(Key(isbn), &id);
+        return id;
+    }
+
+    optional<Book> get(BookId id) const {
+        Record r;
+        if (id == kNoBook || !tree.find(id, &r)) return nullopt;
+        return decode(r);
+    }
+
+    // Returns the ID of the book, creating an ISBN-only entry if needed.
+    BookId getOrCreate(string_view isbn) {
+        if (BookId id = idOf(isbn)) return id;
+        Record r{};
+        r.isbn = Key(isbn);
+        BookId id = BookId(size() + 1);
+        commit(PutOp{kPut, id, r});
+        return id;
+    }
+
+    bool isbnExists(string_view isbn) const { return idOf(isbn) != kNoBook; }
+    uint64_t size() const { return tree.size(); }
+
+    // Stores b as book id, which must exist; b.isbn may differ from the
+    // current one if it is not taken.
+    void update(BookId id, const Book &b) {
+        forEachSegment(b.keyword.view(), [&](string_view seg) { intern(seg); });
+        Record r{b.isbn, b.name, intern(b.author.view()), intern(b.keyword.view()), b.stock, b.price.cents()};
+        commit(PutOp{kPut, id, r});
+    }
+
+    // Adds delta to the stock of an existing book.
+    void adjustStock(BookId id, long long delta) { commit(StockOp{kStock, id, delta}); }
+
+    // Visits every book in ascending ISBN order.
+    template <class F>
+    void forEach(F &&visit) const {
+        for (auto c = byIsbn.begin(); c.valid(); c.next()) visitId(c.value(), visit);
+    }
+
+    // Visits the book with the given ISBN, if any.
+    template <class F>
+    void forIsbn(string_view isbn, F &&visit) const {
+        if (BookId id = idOf(isbn)) visitId(id, visit);
+    }
+
+    // Visit the books with the given name / author / keyword segment, in
+    // ascending ISBN order.
+    template <class F> void forEachWithName(string_view name, F &&visit) const { scan(byName, name, visit); }
+    template <class F> void forEachWithAuthor(string_view author, F &&visit) const { scan(byAuthor, codeOf(author), visit); }
+    template <class F> void forEachWithKeyword(string_view segment, F &&visit) const { scan(byKeyword, codeOf(segment), visit); }
+
+    // Replaces the catalogue with the books scan(visit) passes to visit, in
+    // strictly ascending ISBN order, giving them IDs in that order. scan is
+    // called once per tree and must produce the same books every time. The
+    // dictionary, the records and each index are built bottom-up with full
+    // pages, one after another so that only one index's keys are sorted in
+    // memory at a time, and nothing is logged. Checkpoints when done.
+    template <class F>
+    void bulkLoad(F &&scan) {
+        // codes in order of first use, as update() would intern them
+        unordered_map<string, TextCode> dictionary;
+        vector<Text> byCode(1);
+        auto code = [&](string_view text) -> TextCode {
+            if (text.empty()) return kNoText;
+            auto [it, fresh] = dictionary.try_emplace(string(text), TextCode(byCode.size()));
+            if (fresh) byCode.push_back(Text(text));
+            return it->second;
+        };
+        scan([&](const Book &b) {
+            forEachSegment(b.keyword.view(), code);
+            code(b.author.view());
+            code(b.keyword.view());
+        });
+        texts.rebuild(1.0, [&](auto &&add) {
+            for (TextCode c = 1; c < byCode.size(); ++c) { add(c, byCode[c]); segment.maybeCheckpoint(); }
+        });
+        vector<TextCode> byText(byCode.size() - 1);
+        iota(byText.begin(), byText.end(), TextCode(1));
+        sort(byText.begin(), byText.end(), [&](TextCode a, TextCode b) { return byCode[a] < byCode[b]; });
+        codes.rebuild(1.0, [&](auto &&add) {
+            for (TextCode c : byText) { add(byCode[c], c); segment.maybeCheckpoint(); }
+        });
+        mirrored.assign(byCode.begin(), byCode.begin() + min<size_t>(byCode.size(), kMirrored));
+
+        tree.rebuild(1.0, [&](auto &&add) {
+            BookId id = 0;
+            scan([&](const Book &b) {
+                add(++id, Record{b.isbn, b.name, code(b.author.view()), code(b.keyword.view()), b.stock, b.price.cents()});
+                segment.maybeCheckpoint();
+            });
+        });
+        byIsbn.rebuild(1.0, [&](auto &&add) {
+            BookId id = 0;
+            scan([&](const Book &b) { add(b.isbn, ++id); segment.maybeCheckpoint(); });
+        });
+        loadIndex(byName, [&](auto &&push) {
+            BookId id = 0;
+            scan([&](const Book &b) { ++id; if (b.name.size()) push(IndexKey{b.name, b.isbn}, id); });
+        });
+        loadIndex(byAuthor, [&](auto &&push) {
+            BookId id = 0;
+            scan([&](const Book &b) { ++id; if (TextCode c = code(b.author.view())) push(CodeKey{c, b.isbn}, id); });
+        });
+        loadIndex(byKeyword, [&](auto &&push) {
+            BookId id = 0;
+            scan([&](const Book &b) {
+                ++id;
+                forEachSegment(b.keyword.view(), [&](string_view seg) { if (TextCode c = code(seg)) push(CodeKey{c, b.isbn}, id); });
+            });
+        });
+        segment.checkpoint();
+    }
+
+  private:
+    static constexpr size_t kIsbnLen = 20;
+    using Key = storage::FixedString<kIsbnLen>;
+    using Text = storage::FixedString<60>;
+    using TextCode = uint32_t;
+    static constexpr TextCode kNoText = 0; // the empty string, or a text never interned
+    static constexpr TextCode kMirrored = 1 << 14; // 960 KiB of texts at most
+
+    struct Record {
+        Key isbn;
+        Text name;
+        TextCode author;
+        TextCode keyword;
+        long long stock;
+        int64_t priceCents;
+    };
+
+    struct IndexKey {
+        Text text;
+        Key isbn;
+        friend bool operator<(const IndexKey &a, const IndexKey &b) {
+            int c = memcmp(a.text.data, b.text.data, sizeof a.text.data);
+            return c != 0 ? c < 0 : a.isbn < b.isbn;
+        }
+    };
+    using Index = storage::BPlusTree<IndexKey, BookId>;
+
+    struct CodeKey {
+        TextCode code;
+        Key isbn;
+        friend bool operator<(const CodeKey &a, const CodeKey &b) {
+            return a.code != b.code ? a.code < b.code : a.isbn < b.isbn;
+        }
+    };
+    using CodeIndex = storage::BPlusTree<CodeKey, BookId>;
+
+    // redo log records
+    enum : uint8_t { kPut = 1, kStock = 2, kIntern = 3 };
+    struct PutOp { uint8_t op; BookId id; Record rec; };
+    struct StockOp { uint8_t op; BookId id; long long delta; };
+    struct InternOp { uint8_t op; TextCode code; Text text; };
+
+    template <class Op>
+    void commit(const Op &op) {
+        segment.logOp(&op, sizeof op);
+        apply(string_view(reinterpret_cast<const char *>(&op), sizeof op));
+    }
+
+    void apply(string_view op) {
+        if (op.empty()) return;
+        if (op[0] == kPut && op.size() == sizeof(PutOp)) {
+            PutOp o; memcpy(&o, op.data(), sizeof o);
+            Record old;
+            bool had = tree.find(o.id, &old);
+            if (had) tree.assign(o.id, o.rec); else tree.insert(o.id, o.rec);
+            reindex(o.id, had ? &old : nullptr, o.rec);
+        } else if (op[0] == kStock && op.size() == sizeof(StockOp)) {
+            StockOp o; memcpy(&o, op.data(), sizeof o);
+            tree.modify(o.id, [&](Record &r) { r.stock += o.delta; });
+        } else if (op[0] == kIntern && op.size() == sizeof(InternOp)) {
+            InternOp o; memcpy(&o, op.data(), sizeof o);
+            if (codes.insert(o.text, o.code)) { texts.insert(o.code, o.text); mirror(o.code, o.text); }
+        }
+    }
+
+    // Code of text, interning it first if needed.
+    TextCode intern(string_view text) {
+        if (text.empty()) return kNoText;
+        if (TextCode c = codeOf(text)) return c;
+        TextCode c = TextCode(texts.size() + 1);
+        commit(InternOp{kIntern, c, Text(text)});
+        return c;
+    }
+    // Code of text, or kNoText if it was never interned.
+    TextCode codeOf(string_view text) const {
+        TextCode c = kNoText;
+        if (!text.empty() && text.size() <= sizeof(Text)) codes.find(Text(text), &c);
+        return c;
+    }
+    Text textOf(TextCode code) const {
+        if (code < mirrored.size()) return mirrored[code];
+        Text t;
+        texts.find(code, &t);
+        return t;
+    }
+    // Only apply() and the constructor extend the mirror, so readers on
+    // several threads may share it.
+    void mirror(TextCode code, const Text &text) {
+        if (code >= kMirrored) return;
+        if (code >= mirrored.size()) mirrored.resize(code + 1);
+        mirrored[code] = text;
+    }
+
+    // Moves the index entries of book id from old to rec, leaving untouched
+    // the fields that did not change.
+    void reindex(BookId id, const Record *old, const Record &rec) {
+        bool moved = !old || old->isbn != rec.isbn;
+        if (moved) {
+            if (old) byIsbn.erase(old->isbn);
+            byIsbn.insert(rec.isbn, id);
+        }
+        auto relink = [&](Index &idx, const Text *before, const Text &after) {
+            if (before && !moved && *before == after) return;
+            if (before) link(idx, before->view(), old->isbn, id, false);
+            link(idx, after.view(), rec.isbn, id, true);
+        };
+        relink(byName, old ? &old->name : nullptr, rec.name);
+        if (!old || moved || old->author != rec.author) {
+            if (old) link(byAuthor, old->author, old->isbn, id, false);
+            link(byAuthor, rec.author, rec.isbn, id, true);
+        }
+        if (old && !moved && old->keyword == rec.keyword) return;
+        if (old) forEachSegment(textOf(old->keyword).view(), [&](string_view seg) { link(byKeyword, codeOf(seg), old->isbn, id, false); });
+        forEachSegment(textOf(rec.keyword).view(), [&](string_view seg) { link(byKeyword, codeOf(seg), rec.isbn, id, true); });
+    }
+
+    // Builds index idx from the (key, ID) pairs collect(push) passes to push,
+    // sorted; a keyword segment repeated within one book is indexed once.
+    template <class K, class F>
+    void loadIndex(storage::BPlusTree<K, BookId> &idx, F &&collect) {
+        vector<pair<K, BookId>> keys;
+        collect([&](const K &k, BookId id) { keys.emplace_back(k, id); });
+        auto less = [](const pair<K, BookId> &a, const pair<K, BookId> &b) { return a.first < b.first; };
+        sort(keys.begin(), keys.end(), less);
+        keys.erase(unique(keys.begin(), keys.end(), [&](auto &a, auto &b) { return !less(a, b) && !less(b, a); }), keys.end());
+        idx.rebuild(1.0, [&](auto &&add) {
+            for (auto &[k, id] : keys) { add(k, id); segment.maybeCheckpoint(); }
+        });
+    }
+
+    static void link(Index &idx, string_view text, const Key &isbn, BookId id, bool add) {
+        if (text.empty()) return;
+        IndexKey k{Text(text), isbn};
+        if (add) idx.insert(k, id); else idx.erase(k);
+    }
+    static void link(CodeIndex &idx, TextCode code, const Key &isbn, BookId id, bool add) {
+        if (code == kNoText) return;
+        CodeKey k{code, isbn};
+        if (add) idx.insert(k, id); else idx.erase(k);
+    }
+
+    template <class F>
+    static void forEachSegment(string_view keyword, F &&visit) {
+        while (!keyword.empty()) {
+            size_t bar = keyword.find('|');
+            visit(keyword.substr(0, bar));
+            if (bar == string_view::npos) break;
+            keyword.remove_prefix(bar + 1);
+        }
+    }
+
+    template <class F>
+    void visitId(BookId id, F &visit) const {
+        Record r;
+        if (!tree.find(id, &r)) return;
+        Text author = textOf(r.author), keyword = textOf(r.keyword);
+        visit(BookRow{id, r.isbn.view(), r.name.view(), author.view(), keyword.view(), r.stock, Money::fromCents(r.priceCents)});
+    }
+
+    template <class F>
+    void scan(const Index &idx, string_view text, F &visit) const {
+        if (text.size() > sizeof(Text)) return;
+        IndexKey lo{Text(text), Key()};
+        for (auto c = idx.lowerBound(lo); c.valid() && c.key().text == lo.text; c.next()) visitId(c.value(), visit);
+    }
+    template <class F>
+    void scan(const CodeIndex &idx, TextCode code, F &visit) const {
+        if (code == kNoText) return;
+        for (auto c = idx.lowerBound(CodeKey{code, Key()}); c.valid() && c.key().code == code; c.next()) visitId(c.value(), visit);
+    }
+
+    Book decode(const Record &r) const {
+        return Book{r.isbn, r.name, textOf(r.author), textOf(r.keyword), r.stock, Money::fromCents(r.priceCents)};
+    }
+
+    storage::Segment segment;
+    storage::BPlusTree<BookId, Record> tree;
+    storage::BPlusTree<Key, BookId> byIsbn;
+    Index byName;
+    CodeIndex byAuthor, byKeyword;
+    storage::BPlusTree<Text, TextCode> codes;
+    storage::BPlusTree<TextCode, Text> texts;
+    vector<Text> mirrored = vector<Text>(1); // texts by code, for codes below kMirrored
+};
+
+struct Session {
+    vector<Account> stack; // login stack
+    vector<BookId> selectedStack; // per-login selected book, kNoBook if none
+
+    int currentPrivilege() const { return stack.empty()?0:stack.back().privilege; }
+    BookId& currentSelected() {
+        if (selectedStack.empty()) return none = kNoBook;
+        return selectedStack.back();
+    }
+
+  private:
+    BookId none = kNoBook; // what currentSelected() hands out with nobody logged in
+};
+
+// How many times each account is logged in across the sessions of a server
+// (a session's own logins are also on its stack). Guarded by its own latch,
+// since su and logout run concurrently with each other.
+class LoginTable {
+  public:
+    void add(string_view userId) {
+        lock_guard<mutex> guard(latch);
+        ++counts[string(userId)];
+    }
+    void remove(string_view userId) {
+        lock_guard<mutex> guard(latch);
+        auto it = counts.find(userId);
+        if (it != counts.end() && --it->second == 0) counts.erase(it);
+    }
+    bool contains(string_view userId) const {
+        lock_guard<mutex> guard(latch);
+        return counts.find(userId) != counts.end();
+    }
+
+  private:
+    mutable mutex latch;
+    map<string, int, less<>> counts;
+};
+
+// Finance database: an append-only ledger of fixed-width binary entries in
+// finance.ledger. Entry i holds the cumulative income and expenditure after
+// the first i+1 transactions, so any suffix sum is two positioned reads and
+// a subtraction, and recording a transaction is a single append. Reads go
+// through the shared buffer pool; appends are written straight to the file
+// and patched into the cached page, and synced per the durability policy.
+// Transactions are only appended by the JournalDB, which logs them first.
+class FinanceDB : public storage::PageSource, public storage::Syncable {
+  public:
+    FinanceDB() : io(stats::io("finance.ledger")) {
+        fd = ::open(storage::path("finance.ledger").c_str(), O_RDWR | O_CREAT | O_APPEND, 0644);
+        if (fd < 0) throw runtime_error("cannot open finance ledger");
+        off_t end = ::lseek(fd, 0, SEEK_END);
+        count = end / (off_t)sizeof(Entry);
+        // drop a torn trailing entry left by an interrupted append
+        if (end % (off_t)sizeof(Entry) && ::ftruncate(fd, count * sizeof(Entry)) != 0) throw runtime_error("cannot repair finance ledger");
+        if (count) last = entry(count - 1);
+        synced = count;
+    }
+    ~FinanceDB() override {
+        storage::bufferPool().drop(*this);
+        if (fd >= 0) ::close(fd);
+    }
+
+    void load(storage::PageId id, void *buf) const override {
+        ssize_t n = ::pread(fd, buf, storage::kPageSize, (off_t)id * storage::kPageSize);
+        if (n < 0) throw runtime_error("ledger read failed");
+        stats::read(io, size_t(n));
+        memset(static_cast<char *>(buf) + n, 0, storage::kPageSize - n);
+    }
+
+    void sync() override {
+        if (synced == count) return;
+        ::fdatasync(fd);
+        stats::sync(io);
+        synced = count;
+    }
+
+    void addIncome(Money amount) { record(amount, Money()); }
+    void addExpenditure(Money amount) { record(Money(), amount); }
+
+    // Visits every transaction in order as (income, expenditure).
+    template <class F>
+    void forEach(F &&visit) const {
+        Entry prev{};
+        for (long long i = 0; i < count; ++i) {
+            Entry e = entry(i);
+            visit(Money::fromCents(int64_t((e.income - prev.income).cents)), Money::fromCents(int64_t((e.expend - prev.expend).cents)));
+            prev = e;
+        }
+    }
+
+    // Appends the transactions scan(add) passes to add as (income,
+    // expenditure), in large sequential writes rather than one per entry.
+    // Syncs when done.
+    template <class F>
+    void bulkAppend(F &&scan) {
+        constexpr size_t kBatch = (1 << 20) / sizeof(Entry);
+        vector<Entry> batch;
+        auto flush = [&] {
+            size_t n = batch.size() * sizeof(Entry);
+            if (!n) return;
+            if (::write(fd, batch.data(), n) != (ssize_t)n) throw runtime_error("ledger append failed");
+            stats::write(io, n);
+            batch.clear();
+        };
+        scan([&](Money income, Money expend) {
+            last.income += income; last.expend += expend;
+            batch.push_back(last);
+            ++count;
+            if (batch.size() == kBatch) flush();
+        });
+        flush();
+        storage::bufferPool().drop(*this); // a cached last page would miss the appends
+        sync();
+    }
+
+    // sum last k transactions; if k==-1 sum all
+    pair<MoneyTotal,MoneyTotal> summarize(long long k) const {
+        if (k < 0 || k >= count) return {last.income, last.expend};
+        if (k == 0) return {MoneyTotal(), MoneyTotal()};
+        Entry base = entry(count - k - 1);
+        return {last.income - base.income, last.expend - base.expend};
+    }
+
+    long long size() const { return count; }
+
+    // Drops the transactions from n on.
+    void truncate(long long n) {
+        if (::ftruncate(fd, (off_t)n * sizeof(Entry)) != 0) throw runtime_error("cannot truncate finance ledger");
+        storage::bufferPool().drop(*this);
+        count = n;
+        last = n ? entry(n - 1) : Entry{};
+        synced = min(synced, n);
+    }
+
+  private:
+    struct Entry {
+        MoneyTotal income;
+        MoneyTotal expend;
+    };
+    static constexpr long long kPerPage = storage::kPageSize / sizeof(Entry);
+    static_assert(storage::kPageSize % sizeof(Entry) == 0);
+
+    Entry entry(long long i) const {
+        Entry e;
+        auto page = storage::bufferPool().fetch(*this, storage::PageId(i / kPerPage));
+        memcpy(&e, page.data() + (i % kPerPage) * sizeof(Entry), sizeof e);
+        return e;
+    }
+
+    void record(Money income, Money expend) {
+        Entry e = last;
+        e.income += income; e.expend += expend;
+        if (::write(fd, &e, sizeof e) != (ssize_t)sizeof e) throw runtime_error("ledger append failed");
+        stats::write(io, sizeof e);
+        storage::bufferPool().update(*this, storage::PageId(count / kPerPage), (count % kPerPage) * sizeof(Entry), &e, sizeof e);
+        last = e; ++count;
+    }
+
+    int fd = -1;
+    stats::Io *io;
+    long long count = 0;
+    long long synced = 0; // entries known to be on disk
+    Entry last{};
+};
+
+// Operation journal: one fixed-width binary entry per completed command in
+// journal.bin, saying who did what. Entries are packed into whole pages and
+// read back in large sequential chunks, so `log` streams straight from disk.
+//
+// Aggregates over the journal live in B+ trees in the "tallies" segment and
+// are bumped as each entry is appended:
+//   slot 0  per-user tallies (imports, modifications, sales, account changes)
+//   slot 1  per-book sales and import spend, keyed by BookId
+//   slot 2  top-seller index on (revenue descending, current ISBN) -> BookId
+//   slot 3  per-bucket stats over fixed runs of kBucketSize transactions
+// so every report costs the size of its output, not of the history. Each
+// buy or import is exactly one finance transaction, in the same order, and
+// the journal appends it to the finance ledger itself.
+//
+// Every entry is logged to the tablespace like any other table mutation,
+// within the command it records, and only then appended to the journal,
+// the ledger and the tallies; so the redo log is the one commit point of a
+// command across all the files it touches. The user row under the empty
+// UserID holds the grand totals, which tell how many entries and
+// transactions the checkpointed trees cover. On open, replaying the logged
+// entries rewrites the journal and ledger from there, and whatever either
+// file holds beyond what the log covers (appends that reached the disk
+// when the log records of their command did not) is cut off.
+class JournalDB : public storage::Syncable {
+  public:
+    enum Action : uint8_t { kRegister = 1, kUseradd, kDelete, kPasswd, kBuy, kImport, kModify };
+
+    struct Entry {
+        int64_t amountCents;
+        int32_t quantity;                // books bought / imported, or the new account's privilege
+        BookId book;                     // the book bought / imported / modified, else kNoBook
+        uint8_t action;
+        storage::FixedString<30> user;   // operator
+        storage::FixedString<30> target; // ISBN or UserID acted upon
+    };
+
+    struct Tally {
+        long long ops;
+        long long imports, imported; // import commands, books brought in
+        long long modifications;
+        long long sales, sold;       // buy commands, books sold
+        long long accountOps;        // register / useradd / delete / passwd
+        MoneyTotal spent, revenue;
+    };
+
+    struct BookTally {
+        long long sold, imported;
+        MoneyTotal revenue, spent;
+        storage::FixedString<20> isbn; // the book's current ISBN, which it ranks under
+    };
+
+    static constexpr long long kBucketSize = 1000;
+    struct Bucket {
+        long long count;
+        int64_t minCents, maxCents; // smallest / largest single transaction
+        MoneyTotal income, expend;
+    };
+
+    explicit JournalDB(FinanceDB &ledger)
+        : ledger(ledger), io(stats::io("journal.bin")), segment(storage::tablespace(), "tallies"), tallies(segment, 0),
+          books(segment, 1), ranking(segment, 2), buckets(segment, 3) {
+        fd = ::open(storage::path("journal.bin").c_str(), O_RDWR | O_CREAT, 0644);
+        if (fd < 0) throw runtime_error("cannot open journal");
+        off_t end = ::lseek(fd, 0, SEEK_END);
+        count = (end / (off_t)storage::kPageSize) * kPerPage + min<long long>((end % (off_t)storage::kPageSize) / (off_t)sizeof(Entry), kPerPage);
+        // drop a torn trailing entry left by an interrupted append
+        if (end != endOf(count) && ::ftruncate(fd, endOf(count)) != 0) throw runtime_error("cannot repair journal");
+        synced = count;
+        segment.replay([&](string_view op) { apply(op); });
+        Tally all = total();
+        if (count > all.ops) truncate(all.ops);
+        if (ledger.size() > all.sales + all.imports) ledger.truncate(all.sales + all.imports);
+    }
+    ~JournalDB() override {
+        // the tallies are checkpointed as the tablespace closes; the entries
+        // they cover must be on disk first
+        sync();
+        if (fd >= 0) ::close(fd);
+    }
+
+    void sync() override {
+        if (synced == count) return;
+        ::fdatasync(fd);
+        stats::sync(io);
+        synced = count;
+    }
+
+    // Records one command; a buy or import also goes to the ledger.
+    void record(Action action, string_view user, string_view target, long long quantity = 0, Money amount = Money(), BookId book = kNoBook) {
+        EntryOp o{};
+        o.op = kEntry; o.seq = count;
+        Entry &e = o.entry;
+        e.amountCents = amount.cents(); e.quantity = int32_t(quantity); e.book = book; e.action = action;
+        e.user.assign(user); e.target.assign(target);
+        segment.logOp(&o, sizeof o);
+        apply(string_view(reinterpret_cast<const char *>(&o), sizeof o));
+    }
+
+    // Appends the entries scan(add) passes to add in large sequential
+    // writes, bumping the tallies as record() does and checkpointing them
+    // as they grow. Syncs and checkpoints when done.
+    template <class F>
+    void bulkAppend(F &&scan) {
+        constexpr size_t kChunk = 1 << 20;
+        vector<char> buf; // the file from offset base on; page tails stay zero
+        off_t base = offsetOf(count);
+        auto flush = [&] {
+            if (buf.empty()) return;
+            if (::pwrite(fd, buf.data(), buf.size(), base) != (ssize_t)buf.size()) throw runtime_error("journal append failed");
+            stats::write(io, buf.size());
+            base += off_t(buf.size());
+            buf.clear();
+        };
+        auto checkpoint = [&] {
+            flush();
+            sync();
+            segment.checkpoint();
+        };
+        scan([&](const Entry &e) {
+            size_t at = size_t(offsetOf(count) - base);
+            buf.resize(at + sizeof e);
+            memcpy(buf.data() + at, &e, sizeof e);
+            ++count;
+            tally(e);
+            if (buf.size() >= kChunk) flush();
+            if (segment.checkpointDue()) checkpoint();
+        });
+        checkpoint();
+    }
+
+    long long size() const { return count; }
+
+    // Visits every entry in order, reading the journal a chunk at a time.
+    template <class F>
+    void forEach(F &&visit) const {
+        constexpr long long kChunkPages = 16;
+        vector<char> buf(kChunkPages * storage::kPageSize);
+        for (long long page = 0, seen = 0; seen < count; page += kChunkPages) {
+            ssize_t n = ::pread(fd, buf.data(), buf.size(), (off_t)page * storage::kPageSize);
+            if (n <= 0) throw runtime_error("journal read failed");
+            stats::read(io, size_t(n));
+            for (long long p = 0; p < kChunkPages && seen < count; ++p)
+                for (long long i = 0; i < kPerPage && seen < count; ++i, ++seen) {
+                    Entry e;
+                    memcpy(&e, buf.data() + p * storage::kPageSize + i * sizeof(Entry), sizeof e);
+                    visit(seen, e);
+                }
+        }
+    }
+
+    // Visits the tally of every user that has done anything, in UserID order.
+    template <class F>
+    void forEachTally(F &&visit) const {
+        for (auto c = tallies.begin(); c.valid(); c.next())
+            if (c.key().size()) visit(c.key().view(), c.value());
+    }
+
+    Tally total() const {
+        Tally t{};
+        tallies.find(Key(), &t);
+        return t;
+    }
+
+    // Visits up to k best-selling books by revenue as (ISBN, tally).
+    template <class F>
+    void forEachTopSeller(long long k, F &&visit) const {
+        for (auto c = ranking.begin(); c.valid() && k-- > 0; c.next()) {
+            BookTally t{};
+            books.find(c.value(), &t);
+            visit(c.key().isbn.view(), t);
+        }
+    }
+
+    // Visits every transaction bucket in order as (index, stats); bucket i
+    // covers transactions [i * kBucketSize, (i + 1) * kBucketSize).
+    template <class F>
+    void forEachBucket(F &&visit) const {
+        for (auto c = buckets.begin(); c.valid(); c.next()) visit((long long)c.key(), c.value());
+    }
+
+  private:
+    using Key = storage::FixedString<30>;
+    using IsbnKey = storage::FixedString<20>;
+    struct RankKey {
+        __int128 revenue;
+        IsbnKey isbn;
+        friend bool operator<(const RankKey &a, const RankKey &b) {
+            return a.revenue != b.revenue ? a.revenue > b.revenue : a.isbn < b.isbn;
+        }
+    };
+    static constexpr long long kPerPage = storage::kPageSize / sizeof(Entry);
+
+    static off_t offsetOf(long long i) { return (off_t)(i / kPerPage) * storage::kPageSize + (off_t)(i % kPerPage) * sizeof(Entry); }
+    static off_t endOf(long long n) { return n ? offsetOf(n - 1) + (off_t)sizeof(Entry) : 0; }
+
+    // redo log record: entry number seq is e
+    enum : uint8_t { kEntry = 1 };
+    struct EntryOp { uint8_t op; int64_t seq; Entry entry; };
+
+    // Writes a logged entry to the journal, and a transaction to the ledger,
+    // at their places in order; in replay, whatever either file held from
+    // there on is dropped first. Then bumps the tallies.
+    void apply(string_view op) {
+        if (op.empty() || op[0] != kEntry || op.size() != sizeof(EntryOp)) return;
+        EntryOp o; memcpy(&o, op.data(), sizeof o);
+        Tally all = total();
+        if (o.seq != all.ops) return; // covered by the checkpointed tallies
+        const Entry &e = o.entry;
+        if (count > o.seq) truncate(o.seq);
+        if (::pwrite(fd, &e, sizeof e, offsetOf(count)) != (ssize_t)sizeof e) throw runtime_error("journal append failed");
+        stats::write(io, sizeof e);
+        ++count;
+        if (e.action == kBuy || e.action == kImport) {
+            long long seq = all.sales + all.imports;
+            if (ledger.size() > seq) ledger.truncate(seq);
+            Money amount = Money::fromCents(e.amountCents);
+            if (e.action == kBuy) ledger.addIncome(amount); else ledger.addExpenditure(amount);
+        }
+        tally(e);
+    }
+
+    // Drops the entries from n on.
+    void truncate(long long n) {
+        if (::ftruncate(fd, endOf(n)) != 0) throw runtime_error("cannot truncate journal");
+        count = n;
+        synced = min(synced, n);
+    }
+
+    // Adds e to its operator's tally and the grand totals, and a buy or
+    // import to its book and transaction bucket.
+    void tally(const Entry &e) {
+        if (e.action == kBuy || e.action == kImport) {
+            Tally all = total();
+            applyTransaction(e, all.sales + all.imports);
+        }
+        if (e.action == kModify && e.book != kNoBook) renameBook(e.book, IsbnKey(e.target.view()));
+        for (const Key &k : {e.user, Key()}) {
+            Tally t{};
+            tallies.find(k, &t);
+            ++t.ops;
+            Money amount = Money::fromCents(e.amountCents);
+            switch (e.action) {
+                case kImport: ++t.imports; t.imported += e.quantity; t.spent += amount; break;
+                case kBuy: ++t.sales; t.sold += e.quantity; t.revenue += amount; break;
+                case kModify: ++t.modifications; break;
+                default: ++t.accountOps; break;
+            }
+            if (!tallies.assign(k, t)) tallies.insert(k, t);
+        }
+    }
+
+    // Follows a book's change of ISBN, so that it ranks under the new one.
+    void renameBook(BookId book, const IsbnKey &isbn) {
+        BookTally bt{};
+        if (!books.find(book, &bt) || bt.isbn == isbn) return;
+        if (ranking.erase(RankKey{bt.revenue.cents, bt.isbn})) ranking.insert(RankKey{bt.revenue.cents, isbn}, book);
+        bt.isbn = isbn;
+        books.assign(book, bt);
+    }
+
+    void applyTransaction(const Entry &e, long long seq) {
+        bool sale = e.action == kBuy;
+        Money amount = Money::fromCents(e.amountCents);
+        BookTally bt{};
+        bool had = books.find(e.book, &bt);
+        bt.isbn = IsbnKey(e.target.view());
+        if (sale) {
+            if (had) ranking.erase(RankKey{bt.revenue.cents, bt.isbn});
+            bt.sold += e.quantity; bt.revenue += amount;
+            ranking.insert(RankKey{bt.revenue.cents, bt.isbn}, e.book);
+        } else {
+            bt.imported += e.quantity; bt.spent += amount;
+        }
+        if (!books.assign(e.book, bt)) books.insert(e.book, bt);
+
+        uint32_t idx = uint32_t(seq / kBucketSize);
+        Bucket b{};
+        if (buckets.find(idx, &b)) {
+            b.minCents = min(b.minCents, e.amountCents); b.maxCents = max(b.maxCents, e.amountCents);
+        } else {
+            b.minCents = b.maxCents = e.amountCents;
+        }
+        ++b.count;
+        (sale ? b.income : b.expend) += amount;
+        if (!buckets.assign(idx, b)) buckets.insert(idx, b);
+    }
+
+    FinanceDB &ledger;
+    int fd = -1;
+    stats::Io *io;
+    long long count = 0;
+    long long synced = 0; // entries known to be on disk
+    storage::Segment segment;
+    storage::BPlusTree<Key, Tally> tallies;
+    storage::BPlusTree<BookId, BookTally> books;
+    storage::BPlusTree<RankKey, BookId> ranking;
+    storage::BPlusTree<uint32_t, Bucket> buckets;
+};
+
+// Validators according to spec
+namespace validate {
+    inline bool ascii_visible_no_quotes(string_view s) {
+        for (unsigned char c: s) {
+            if (c < 32 || c == '"') return false;
+        }
+        return true;
+    }
+    inline bool ascii_visible(string_view s) {
+        for (unsigned char c: s) if (c < 32) return false; return true;
+    }
+    inline bool id_or_password(string_view s) {
+        if (s.size()>30) return false; if (s.empty()) return false;
+        for (unsigned char c: s) if (!(isalnum(c) || c=='_')) return false; return true;
+    }
+    inline bool username(string_view s) {
+        return !s.empty() && s.size()<=30 && ascii_visible(s);
+    }
+    inline bool privilege(string_view s, int &out) {
+        if (s.size()!=1 || !isdigit((unsigned char)s[0])) return false; out = s[0]-'0';
+        return (out==7 || out==3 || out==1);
+    }
+    inline bool isbn(string_view s) {
+        return !s.empty() && s.size()<=20 && ascii_visible(s);
+    }
+    inline bool bookname_or_author(string_view s) {
+        return !s.empty() && s.size()<=60 && ascii_visible_no_quotes(s);
+    }
+    inline bool keyword(string_view s) {
+        if (s.empty() || s.size()>60) return false;
+        if (!ascii_visible_no_quotes(s)) return false;
+        // cannot contain multiple keywords for show; for modify we allow '|' but must handle duplicates later
+        return true;
+    }
+    // '|'-separated segments must be non-empty and pairwise distinct
+    inline bool keyword_segments(string_view s) {
+        array<string_view, 31> segs; size_t n=0, from=0;
+        for (size_t j=0;j<=s.size();++j) {
+            if (j<s.size() && s[j]!='|') continue;
+            string_view seg = s.substr(from, j-from); from = j+1;
+            if (seg.empty()) return false;
+            for (size_t k=0;k<n;++k) if (segs[k]==seg) return false;
+            segs[n++] = seg;
+        }
+        return true;
+    }
+    inline bool quantity(string_view s, long long &out) {
+        if (s.empty() || s.size()>10) return false;
+        long long v = 0;
+        for (char c: s) { if (!isdigit((unsigned char)c)) return false; v = v*10 + (c-'0'); }
+        if (v>2147483647LL) return false;
+        out = v; return true;
+    }
+    inline bool money(string_view s, Money &out) {
+        if (s.empty() || s.size()>13) return false;
+        return Money::parse(s, out);
+    }
+}
+
+// Tokens of one command line. The views point into the line buffer, which
+// tokenize() rewrites in place to drop the quote characters; nothing here
+// allocates. size() counts every token, but only the first kCapacity are
+// kept (no legal command comes close).
+struct Tokens {
+    static constexpr size_t kCapacity = 16;
+
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+    string_view operator[](size_t i) const { return items[i]; }
+    string_view back() const { return items[min(count, kCapacity) - 1]; }
+
+    array<string_view, kCapacity> items;
+    size_t count = 0;
+};
+
+// Splits on whitespace outside double quotes; quotes themselves are removed
+// and a token that ends up empty is dropped.
+static void tokenize(string &line, Tokens &out) {
+    out.count = 0;
+    bool inQuote=false; size_t w=0, start=0;
+    auto push = [&]() {
+        if (w > start) { if (out.count < Tokens::kCapacity) out.items[out.count] = string_view(line.data()+start, w-start); ++out.count; }
+        start = w;
+    };
+    for (size_t i=0;i<line.size();++i) {
+        char c = line[i];
+        if (inQuote) {
+            if (c=='"') inQuote=false;
+            else line[w++] = c;
+        } else if (isspace((unsigned char)c)) {
+            push();
+        } else if (c=='"') {
+            inQuote=true;
+        } else {
+            line[w++] = c;
+        }
+    }
+    push();
+}
+
+// Flags of show / modify, keyed by their second character.
+enum class Flag { ISBN, Name, Author, Keyword, Price, None };
+
+static Flag flagOf(string_view key) {
+    if (key.size() < 2) return Flag::None;
+    switch (key[1]) {
+        case 'I': return key=="-ISBN" ? Flag::ISBN : Flag::None;
+        case 'n': return key=="-name" ? Flag::Name : Flag::None;
+        case 'a': return key=="-author" ? Flag::Author : Flag::None;
+        case 'k': return key=="-keyword" ? Flag::Keyword : Flag::None;
+        case 'p': return key=="-price" ? Flag::Price : Flag::None;
+        default: return Flag::None;
+    }
+}
+
+// Everything a command handler can touch.
+struct Context {
+    AccountDB &adb;
+    BookDB &bdb;
+    FinanceDB &fdb;
+    JournalDB &journal;
+    Session &session;
+    OutputBuffer &out;
+    bool running = true;
+    LoginTable *logins = nullptr; // server mode: logins of every client
+
+    int curPriv() const { return session.currentPrivilege(); }
+    // UserID of the account the current command runs as
+    string_view who() const { return session.stack.empty() ? string_view() : session.stack.back().userId.view(); }
+};
+
+static void outputInvalid(Context &ctx) { ctx.out << "Invalid\n"; }
+
+static void printMoney(Context &ctx, Money x) {
+    ctx.out << x << '\n';
+}
+
+static void cmdQuit(Context &ctx, const Tokens &) { ctx.running = false; }
+
+static void cmdShowFinance(Context &ctx, const Tokens &tokens) {
+    if (ctx.curPriv()<7) return outputInvalid(ctx);
+    if (tokens.size()==2) {
+        auto [inc, exp] = ctx.fdb.summarize(-1);
+        ctx.out << "+ " << inc << " - " << exp << '\n';
+    } else if (tokens.size()==3) {
+        long long cnt=0; if (!validate::quantity(tokens[2], cnt)) return outputInvalid(ctx);
+        if (cnt==0) { ctx.out << '\n'; return; }
+        if (cnt > ctx.fdb.size()) return outputInvalid(ctx);
+        auto [inc, exp] = ctx.fdb.summarize(cnt);
+        ctx.out << "+ " << inc << " - " << exp << '\n';
+    } else outputInvalid(ctx);
+}
+
+static void cmdSu(Context &ctx, const Tokens &tokens) {
+    if (!(tokens.size()==2 || tokens.size()==3)) return outputInvalid(ctx);
+    string_view uid=tokens[1]; string_view pw = tokens.size()==3?tokens[2]:string_view();
+    if (!validate::id_or_password(uid)) return outputInvalid(ctx);
+    auto a = ctx.adb.get(uid);
+    if (!a) return outputInvalid(ctx);
+    auto &session = ctx.session;
+    bool canOmit = !session.stack.empty() && session.stack.back().privilege > a->privilege;
+    if (pw.empty() && !canOmit) return outputInvalid(ctx);
+    if (!pw.empty() && pw != a->password.view()) return outputInvalid(ctx);
+    session.stack.push_back(*a);
+    session.selectedStack.push_back(kNoBook);
+    if (ctx.logins) ctx.logins->add(uid);
+}
+
+static void cmdLogout(Context &ctx, const Tokens &) {
+    auto &session = ctx.session;
+    if (ctx.curPriv()<1) return outputInvalid(ctx);
+    if (session.stack.empty()) return outputInvalid(ctx);
+    if (ctx.logins) ctx.logins->remove(session.stack.back().userId.view());
+    session.stack.pop_back();
+    if (!session.selectedStack.empty()) session.selectedStack.pop_back();
+}
+
+static void cmdRegister(Context &ctx, const Tokens &tokens) {
+    if (tokens.size()!=4) return outputInvalid(ctx);
+    string_view uid=tokens[1], pw=tokens[2], uname=tokens[3];
+    if (!(validate::id_or_password(uid) && validate::id_or_password(pw) && validate::username(uname))) return outputInvalid(ctx);
+    if (ctx.adb.exists(uid)) return outputInvalid(ctx);
+    ctx.adb.add(Account{uid, pw, 1, uname});
+    ctx.journal.record(JournalDB::kRegister, uid, uid);
+}
+
+static void cmdPasswd(Context &ctx, const Tokens &tokens) {
+    if (ctx.curPriv()<1) return outputInvalid(ctx);
+    if (!(tokens.size()==3 || tokens.size()==4)) return outputInvalid(ctx);
+    string_view uid=tokens[1]; if (!validate::id_or_password(uid)) return outputInvalid(ctx);
+    auto a = ctx.adb.get(uid); if (!a) return outputInvalid(ctx);
+    if (ctx.curPriv()==7) {
+        string_view newpw = tokens.back(); if (!validate::id_or_password(newpw)) return outputInvalid(ctx);
+        ctx.adb.updatePassword(uid, newpw);
+    } else {
+        if (tokens.size()!=4) return outputInvalid(ctx);
+        string_view curpw=tokens[2], newpw=tokens[3];
+        if (!(validate::id_or_password(curpw) && validate::id_or_password(newpw))) return outputInvalid(ctx);
+        if (curpw != a->password.view()) return outputInvalid(ctx);
+        ctx.adb.updatePassword(uid, newpw);
+    }
+    ctx.journal.record(JournalDB::kPasswd, ctx.who(), uid);
+}
+
+static void cmdUseradd(Context &ctx, const Tokens &tokens) {
+    if (ctx.curPriv()<3) return outputInvalid(ctx);
+    if (tokens.size()!=5) return outputInvalid(ctx);
+    string_view uid=tokens[1], pw=tokens[2], privStr=tokens[3], uname=tokens[4];
+    int priv=0; if (!(validate::id_or_password(uid) && validate::id_or_password(pw) && validate::username(uname) && validate::privilege(privStr, priv))) return outputInvalid(ctx);
+    if (priv>=ctx.curPriv()) return outputInvalid(ctx);
+    if (ctx.adb.exists(uid)) return outputInvalid(ctx);
+    ctx.adb.add(Account{uid, pw, priv, uname});
+    ctx.journal.record(JournalDB::kUseradd, ctx.who(), uid, priv);
+}
+
+static void cmdDelete(Context &ctx, const Tokens &tokens) {
+    if (ctx.curPriv()<7) return outputInvalid(ctx);
+    if (tokens.size()!=2) return outputInvalid(ctx);
+    string_view uid=tokens[1]; if (!validate::id_or_password(uid)) return outputInvalid(ctx);
+    if (!ctx.adb.exists(uid)) return outputInvalid(ctx);
+    // cannot delete if logged in
+    for (auto &x: ctx.session.stack) if (x.userId.view()==uid) return outputInvalid(ctx);
+    if (ctx.logins && ctx.logins->contains(uid)) return outputInvalid(ctx);
+    ctx.adb.remove(uid);
+    ctx.journal.record(JournalDB::kDelete, ctx.who(), uid);
+}
+
+static void cmdShow(Context &ctx, const Tokens &tokens) {
+    // show finance must be handled before generic show
+    if (tokens.size()>=2 && tokens[1]=="finance") return cmdShowFinance(ctx, tokens);
+    if (ctx.curPriv()<1) return outputInvalid(ctx);
+    // show; show -ISBN=; -name="" etc.
+    // parse optional single filter
+    Flag ftype = Flag::None; string_view fval;
+    if (tokens.size()>1) {
+        if (tokens.size()!=2) return outputInvalid(ctx);
+        string_view t = tokens[1];
+        auto pos = t.find('='); if (pos==string_view::npos) return outputInvalid(ctx);
+        ftype = flagOf(t.substr(0, pos)); fval = t.substr(pos+1);
+        switch (ftype) {
+            case Flag::ISBN: if (!validate::isbn(fval)) return outputInvalid(ctx); break;
+            case Flag::Name: case Flag::Author: if (!validate::bookname_or_author(fval)) return outputInvalid(ctx); break;
+            case Flag::Keyword:
+                if (!validate::keyword(fval)) return outputInvalid(ctx);
+                if (fval.find('|')!=string_view::npos) return outputInvalid(ctx);
+                break;
+            default: return outputInvalid(ctx);
+        }
+    }
+    // rows are formatted straight into the output buffer as the cursor
+    // walks the tree; nothing is collected or sorted
+    bool any=false;
+    auto &out = ctx.out;
+    auto emit = [&](const BookRow &b) {
+        any=true;
+        out << b.isbn << '\t' << b.name << '\t' << b.author << '\t' << b.keyword << '\t' << b.price << '\t' << b.stock << '\n';
+    };
+    // ISBN is an exact key lookup; name / author / keyword filters go
+    // through the secondary indexes
+    auto &bdb = ctx.bdb;
+    if (ftype==Flag::ISBN) bdb.forIsbn(fval, emit);
+    else if (ftype==Flag::Name) bdb.forEachWithName(fval, emit);
+    else if (ftype==Flag::Author) bdb.forEachWithAuthor(fval, emit);
+    else if (ftype==Flag::Keyword) bdb.forEachWithKeyword(fval, emit);
+    else bdb.forEach(emit);
+    if (!any) out << '\n'; // empty line when no books
+}
+
+static void cmdBuy(Context &ctx, const Tokens &tokens) {
+    if (ctx.curPriv()<1) return outputInvalid(ctx);
+    if (tokens.size()!=3) return outputInvalid(ctx);
+    string_view isbn=tokens[1]; long long qty=0; if (!validate::isbn(isbn) || !validate::quantity(tokens[2], qty) || qty<=0) return outputInvalid(ctx);
+    BookId id = ctx.bdb.idOf(isbn);
+    auto b = ctx.bdb.get(id); if (!b) return outputInvalid(ctx);
+    if (b->stock < qty) return outputInvalid(ctx);
+    Money cost; if (!b->price.mul(qty, cost)) return outputInvalid(ctx);
+    ctx.bdb.adjustStock(id, -qty);
+    ctx.journal.record(JournalDB::kBuy, ctx.who(), isbn, qty, cost, id);
+    printMoney(ctx, cost);
+}
+
+static void cmdSelect(Context &ctx, const Tokens &tokens) {
+    if (ctx.curPriv()<3) return outputInvalid(ctx);
+    if (tokens.size()!=2) return outputInvalid(ctx);
+    string_view isbn=tokens[1]; if (!validate::isbn(isbn)) return outputInvalid(ctx);
+    // create if not exist
+    ctx.session.currentSelected() = ctx.bdb.getOrCreate(isbn);
+}
+
+static void cmdModify(Context &ctx, const Tokens &tokens) {
+    if (ctx.curPriv()<3) return outputInvalid(ctx);
+    if (tokens.size()<2) return outputInvalid(ctx);
+    auto &session = ctx.session; auto &bdb = ctx.bdb;
+    BookId id = session.currentSelected();
+    auto b = bdb.get(id); if (!b) return outputInvalid(ctx);
+    // one token per distinct flag at most
+    if (tokens.size() > 1 + size_t(Flag::None)) return outputInvalid(ctx);
+    Book nb = *b;
+    unsigned seen = 0;
+    for (size_t i=1;i<tokens.size();++i) {
+        string_view t = tokens[i]; auto pos=t.find('='); if (pos==string_view::npos) return outputInvalid(ctx);
+        Flag k=flagOf(t.substr(0,pos)); string_view v=t.substr(pos+1);
+        if (k==Flag::None) return outputInvalid(ctx);
+        // no duplicate flags
+        if (seen & (1u << int(k))) return outputInvalid(ctx);
+        seen |= 1u << int(k);
+        switch (k) {
+            case Flag::ISBN:
+                if (!validate::isbn(v) || v==b->isbn.view() || bdb.isbnExists(v)) return outputInvalid(ctx);
+                nb.isbn=v; break;
+            case Flag::Name: if (!validate::bookname_or_author(v)) return outputInvalid(ctx); nb.name=v; break;
+            case Flag::Author: if (!validate::bookname_or_author(v)) return outputInvalid(ctx); nb.author=v; break;
+            case Flag::Keyword:
+                // no duplicate segments
+                if (!validate::keyword(v) || !validate::keyword_segments(v)) return outputInvalid(ctx);
+                nb.keyword=v; break;
+            case Flag::Price: if (!validate::money(v, nb.price)) return outputInvalid(ctx); break;
+            default: return outputInvalid(ctx);
+        }
+    }
+    // an ISBN change only moves index keys; every selection holds the ID
+    bdb.update(id, nb);
+    ctx.journal.record(JournalDB::kModify, ctx.who(), nb.isbn.view(), 0, Money(), id);
+}
+
+static void cmdImport(Context &ctx, const Tokens &tokens) {
+    if (ctx.curPriv()<3) return outputInvalid(ctx);
+    if (tokens.size()!=3) return outputInvalid(ctx);
+    BookId id = ctx.session.currentSelected();
+    if (id==kNoBook) return outputInvalid(ctx);
+    long long qty=0; Money total; if (!validate::quantity(tokens[1], qty) || !validate::money(tokens[2], total) || qty<=0 || total<=Money()) return outputInvalid(ctx);
+    auto b = ctx.bdb.get(id); if (!b) return outputInvalid(ctx);
+    ctx.bdb.adjustStock(id, qty);
+    ctx.journal.record(JournalDB::kImport, ctx.who(), b->isbn.view(), qty, total, id);
+}
+
+// `log`: every journaled operation, oldest first, streamed from the journal.
+static void cmdLog(Context &ctx, const Tokens &tokens) {
+    if (ctx.curPriv()<7) return outputInvalid(ctx);
+    if (tokens.size()!=1) return outputInvalid(ctx);
+    static constexpr string_view kAction[] = {"?", "register", "useradd", "delete", "passwd", "buy", "import", "modify"};
+    auto &out = ctx.out;
+    out << "log: " << ctx.journal.size() << " operations\n";
+    ctx.journal.forEach([&](long long seq, const JournalDB::Entry &e) {
+        uint8_t a = e.action < size(kAction) ? e.action : 0;
+        out << seq + 1 << '\t' << e.user.view() << '\t' << kAction[a] << '\t' << e.target.view();
+        if (a==JournalDB::kBuy) out << '\t' << (long long)e.quantity << "\t+" << Money::fromCents(e.amountCents);
+        else if (a==JournalDB::kImport) out << '\t' << (long long)e.quantity << "\t-" << Money::fromCents(e.amountCents);
+        else if (a==JournalDB::kUseradd) out << "\tprivilege " << (long long)e.quantity;
+        out << '\n';
+    });
+}
+
+static void reportEmployee(Context &ctx) {
+    auto &out = ctx.out;
+    auto row = [&](string_view who, const JournalDB::Tally &t) {
+        out << who << '\t' << t.ops << '\t' << t.imports << '\t' << t.imported << '\t' << t.spent << '\t' << t.modifications
+            << '\t' << t.sales << '\t' << t.sold << '\t' << t.revenue << '\t' << t.accountOps << '\n';
+    };
+    out << "employee report\n";
+    out << "UserID\toperations\timports\tbooks imported\tspent\tmodifications\tsales\tbooks sold\trevenue\taccount changes\n";
+    ctx.journal.forEachTally(row);
+    row("(total)", ctx.journal.total());
+}
+
+static void reportFinance(Context &ctx) {
+    constexpr long long kTopSellers = 10;
+    auto &out = ctx.out;
+    auto [inc, exp] = ctx.fdb.summarize(-1);
+    out << "finance report\n";
+    out << "transactions\t" << ctx.fdb.size() << '\n';
+    out << "income\t" << inc << "\nexpenditure\t" << exp << "\nprofit\t" << inc - exp << '\n';
+    out << "top sellers\nrank\tISBN\tsold\trevenue\timported\tspent\n";
+    long long rank = 0;
+    ctx.journal.forEachTopSeller(kTopSellers, [&](string_view isbn, const JournalDB::BookTally &t) {
+        out << ++rank << '\t' << isbn << '\t' << t.sold << '\t' << t.revenue << '\t' << t.imported << '\t' << t.spent << '\n';
+    });
+    out << "trend per " << JournalDB::kBucketSize << " transactions\nfrom\tto\tcount\tincome\texpenditure\tmin\tmax\n";
+    ctx.journal.forEachBucket([&](long long i, const JournalDB::Bucket &b) {
+        long long from = i * JournalDB::kBucketSize;
+        out << from + 1 << '\t' << from + b.count << '\t' << b.count << '\t' << b.income << '\t' << b.expend
+            << '\t' << Money::fromCents(b.minCents) << '\t' << Money::fromCents(b.maxCents) << '\n';
+    });
+}
+
+static void cmdReport(Context &ctx, const Tokens &tokens) {
+    if (ctx.curPriv()<7) return outputInvalid(ctx);
+    if (tokens.size()!=2) return outputInvalid(ctx);
+    if (tokens[1]=="employee") return reportEmployee(ctx);
+    if (tokens[1]=="finance") return reportFinance(ctx);
+    outputInvalid(ctx);
+}
+
+// Command keyword dispatch: a collision-free hash of (length, first char,
+// last char) indexes a 32-slot table, and one string compare confirms.
+// Read-only commands change nothing but the caller's own session, so the
+// server runs them concurrently with each other.
+using Handler = void (*)(Context &, const Tokens &);
+struct CommandEntry { string_view name; Handler run = nullptr; bool readOnly = false; };
+
+constexpr size_t commandSlot(string_view s) {
+    return (2 * s.size() + 10 * (unsigned char)s.front() + (unsigned char)s.back()) & 31;
+}
+
+static constexpr array<CommandEntry, 32> kCommands = [] {
+    array<CommandEntry, 32> t{};
+    const CommandEntry all[] = {
+        {"quit", cmdQuit, true}, {"exit", cmdQuit, true},
+        {"su", cmdSu, true}, {"logout", cmdLogout, true}, {"register", cmdRegister}, {"passwd", cmdPasswd},
+        {"useradd", cmdUseradd}, {"delete", cmdDelete},
+        {"show", cmdShow, true}, {"buy", cmdBuy}, {"select", cmdSelect}, {"modify", cmdModify}, {"import", cmdImport},
+        {"log", cmdLog, true}, {"report", cmdReport, true},
+    };
+    for (const auto &c : all) t[commandSlot(c.name)] = c;
+    return t;
+}();
+static_assert([] {
+    size_t used = 0;
+    for (const auto &c : kCommands) used += c.run != nullptr;
+    return used == 15;
+}(), "command keywords collide in the dispatch table");
+
+
+static const CommandEntry *lookup(string_view cmd) {
+    const CommandEntry &entry = kCommands[commandSlot(cmd)];
+    return entry.run && entry.name == cmd ? &entry : nullptr;
+}
+
+static void dispatch(Context &ctx, const Tokens &tokens, const CommandEntry *entry, stats::CommandTimer &timer) {
+    auto space = storage::tablespace();
+    space->beginCommand();
+    if (entry) entry->run(ctx, tokens);
+    else outputInvalid(ctx);
+    space->endCommand(); // before the sync, so that it covers the whole command
+    storage::durability().commandDone();
+    timer.done(entry ? entry->name : "(unknown)");
+}
+
+// Runs one input line (tokenized in place) against ctx. A blank line is
+// legal and produces no output.
+inline void execute(Context &ctx, string &line) {
+    stats::CommandTimer timer;
+    Tokens tokens;
+    tokenize(line, tokens);
+    if (tokens.empty()) return;
+    dispatch(ctx, tokens, lookup(tokens[0]), timer);
+}
+
+// A command line tokenized and looked up ahead of execution. Parsing reads
+// no table or session state, so batch mode does it on another thread.
+struct ParsedCommand {
+    string line; // tokens point into this buffer; do not move once parsed
+    Tokens tokens;
+    const CommandEntry *entry = nullptr; // null: unknown command
+};
+
+inline void parse(ParsedCommand &cmd) {
+    tokenize(cmd.line, cmd.tokens);
+    cmd.entry = cmd.tokens.empty() ? nullptr : lookup(cmd.tokens[0]);
+}
+
+inline void execute(Context &ctx, const ParsedCommand &cmd) {
+    if (cmd.tokens.empty()) return;
+    stats::CommandTimer timer;
+    dispatch(ctx, cmd.tokens, cmd.entry, timer);
+}
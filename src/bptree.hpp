@@ -0,0 +1,391 @@
+#pragma once
+#include <bits/stdc++.h>
+#include "tablespace.hpp"
+
+namespace storage {
+
+// Disk-resident B+ tree over fixed-size pages of a Segment. Keys and values
+// are trivially copyable and stored inline; keys are unique and ordered by
+// operator<. Each tree owns one root slot of its segment, so a table and
+// its indexes can share a single segment.
+//
+// Nodes are accessed in place through pinned buffer pool pages; only the
+// pages on the current root-to-leaf path are pinned at any time. Erasing
+// never merges nodes: leaves may become underfull or empty, and lookups and
+// cursors simply step over them. Instead, a tree whose pages hold less than
+// a third of what they could is rebuilt bottom-up at the next checkpoint,
+// or as it closes, and its old pages go back to the free list.
+template <class Key, class Value>
+class BPlusTree : public Compactable {
+    static_assert(std::is_trivially_copyable_v<Key> && std::is_trivially_copyable_v<Value>);
+
+    struct NodeHeader {
+        std::uint16_t leaf;
+        std::uint16_t count;
+        PageId next; // right sibling, leaves only
+    };
+    static constexpr int kLeafCap = (kPageSize - sizeof(NodeHeader)) / (sizeof(Key) + sizeof(Value));
+    static constexpr int kInnerCap = (kPageSize - sizeof(NodeHeader) - sizeof(PageId)) / (sizeof(Key) + sizeof(PageId));
+    static_assert(kLeafCap >= 3 && kInnerCap >= 3, "record too large for a page");
+
+    struct Leaf {
+        NodeHeader h;
+        Key keys[kLeafCap];
+        Value vals[kLeafCap];
+    };
+    struct Inner {
+        NodeHeader h;
+        Key keys[kInnerCap];
+        PageId kids[kInnerCap + 1];
+    };
+    static_assert(sizeof(Leaf) <= kPageSize && sizeof(Inner) <= kPageSize);
+
+    static NodeHeader &head(const PageRef &p) { return *reinterpret_cast<NodeHeader *>(p.data()); }
+    static Leaf &leaf(const PageRef &p) { return *reinterpret_cast<Leaf *>(p.data()); }
+    static Inner &inner(const PageRef &p) { return *reinterpret_cast<Inner *>(p.data()); }
+
+  public:
+    BPlusTree(Segment &file, int slot) : file(file), slot(slot) { file.attach(this); }
+    ~BPlusTree() override {
+        // the closing checkpoint runs once every tree is gone, so this is
+        // the last chance to give back the pages of a thinned-out tree
+        try { compactIfSparse(); } catch (...) {}
+        file.detach(this);
+    }
+    BPlusTree(const BPlusTree &) = delete;
+    BPlusTree &operator=(const BPlusTree &) = delete;
+
+    // Number of entries, from the file header.
+    std::uint64_t size() const { return file.records(slot); }
+
+    // Ordered forward iterator over (key, value) pairs; pins one leaf page.
+    class Cursor {
+      public:
+        bool valid() const { return bool(page); }
+        const Key &key() const { return leaf(page).keys[pos]; }
+        const Value &value() const { return leaf(page).vals[pos]; }
+        void next() { ++pos; settle(); }
+
+      private:
+        friend class BPlusTree;
+        Cursor(const Segment &file, PageRef page, int pos) : file(&file), page(std::move(page)), pos(pos) { settle(); }
+        // advance across exhausted (or empty) leaves
+        void settle() {
+            while (page && pos >= head(page).count) {
+                PageId next = head(page).next;
+                page = next == kNullPage ? PageRef() : file->pin(next);
+                pos = 0;
+            }
+        }
+        const Segment *file;
+        PageRef page;
+        int pos;
+    };
+
+    Cursor begin() const {
+        PageId id = file.root(slot);
+        if (id == kNullPage) return Cursor(file, PageRef(), 0);
+        PageRef p = file.pin(id);
+        while (!head(p).leaf) p = file.pin(inner(p).kids[0]);
+        return Cursor(file, std::move(p), 0);
+    }
+
+    // First entry whose key is not less than k.
+    Cursor lowerBound(const Key &k) const {
+        PageRef p = descend(k);
+        if (!p) return Cursor(file, PageRef(), 0);
+        int i = leafPos(leaf(p), k);
+        return Cursor(file, std::move(p), i);
+    }
+
+    bool find(const Key &k, Value *out = nullptr) const {
+        PageRef p = descend(k);
+        if (!p) return false;
+        Leaf &l = leaf(p);
+        int i = leafPos(l, k);
+        if (i == l.h.count || k < l.keys[i]) return false;
+        if (out) *out = l.vals[i];
+        return true;
+    }
+
+    // Inserts a new entry; returns false (and changes nothing) if k exists.
+    bool insert(const Key &k, const Value &v) {
+        PageId root = file.root(slot);
+        if (root == kNullPage) {
+            PageRef p = file.pinNew(slot, root);
+            Leaf &l = leaf(p);
+            l.h.leaf = 1; l.h.count = 1; l.h.next = kNullPage;
+            l.keys[0] = k; l.vals[0] = v;
+            file.setRoot(slot, root);
+            file.addRecords(slot, 1);
+            return true;
+        }
+        Split up;
+        bool inserted = insertAt(root, k, v, up);
+        if (up.page != kNullPage) {
+            PageId nr;
+            PageRef p = file.pinNew(slot, nr);
+            Inner &n = inner(p);
+            n.h.leaf = 0; n.h.count = 1; n.h.next = kNullPage;
+            n.keys[0] = up.key;
+            n.kids[0] = root; n.kids[1] = up.page;
+            file.setRoot(slot, nr);
+        }
+        if (inserted) file.addRecords(slot, 1);
+        return inserted;
+    }
+
+    // Overwrites the value of an existing key; returns false if k is absent.
+    bool assign(const Key &k, const Value &v) {
+        return modify(k, [&](Value &old) { old = v; });
+    }
+
+    // Edits the value of an existing key in place, on its leaf page; returns
+    // false if k is absent.
+    template <class F>
+    bool modify(const Key &k, F &&edit) {
+        PageRef p = descend(k);
+        if (!p) return false;
+        Leaf &l = leaf(p);
+        int i = leafPos(l, k);
+        if (i == l.h.count || k < l.keys[i]) return false;
+        edit(l.vals[i]);
+        p.markDirty();
+        return true;
+    }
+
+    bool erase(const Key &k) {
+        PageRef p = descend(k);
+        if (!p) return false;
+        Leaf &l = leaf(p);
+        int i = leafPos(l, k);
+        if (i == l.h.count || k < l.keys[i]) return false;
+        int tail = l.h.count - i - 1;
+        std::memmove(&l.keys[i], &l.keys[i + 1], tail * sizeof(Key));
+        std::memmove(&l.vals[i], &l.vals[i + 1], tail * sizeof(Value));
+        --l.h.count;
+        p.markDirty();
+        file.addRecords(slot, -1);
+        return true;
+    }
+
+    // Replaces the contents of the tree with the entries produce(add) passes
+    // to add, in strictly ascending key order, built bottom-up with each node
+    // filled to the given fraction of its capacity; the old pages are freed
+    // once the new tree is in place. The producer may checkpoint between
+    // entries.
+    template <class F>
+    void rebuild(double fill, F &&produce) {
+        std::vector<PageId> old;
+        collect(file.root(slot), old);
+        Builder b(file, slot, fill);
+        rebuilding = true;
+        struct Reset { bool &flag; ~Reset() { flag = false; } } reset{rebuilding};
+        std::int64_t n = 0;
+        produce([&](const Key &k, const Value &v) { b.add(k, v); ++n; });
+        file.setRoot(slot, b.finish());
+        file.addRecords(slot, n - std::int64_t(size()));
+        for (PageId id : old) file.freePage(slot, id);
+    }
+
+    // Rebuilds the tree with every node three-quarters full.
+    void compact() {
+        rebuild(0.75, [&](auto &&add) {
+            for (auto c = begin(); c.valid(); c.next()) add(c.key(), c.value());
+        });
+    }
+
+    void compactIfSparse() override {
+        if (rebuilding) return;
+        std::uint64_t leaves = (size() + kLeafCap - 1) / kLeafCap;
+        if (file.pages(slot) > 3 * leaves + kCompactSlack) compact();
+    }
+
+  private:
+    static constexpr std::uint32_t kCompactSlack = 16; // pages; small trees are left alone
+
+    // Builds a tree bottom-up from entries added in ascending key order. Only
+    // the rightmost node of each level is pinned, and every write to one
+    // re-dirties it, since a checkpoint may clean it in between; finish()
+    // returns the root.
+    class Builder {
+      public:
+        Builder(Segment &file, int slot, double fill)
+            : file(file), slot(slot), leafFill(std::max(1, int(kLeafCap * fill))), innerFill(std::max(1, int(kInnerCap * fill))) {}
+
+        void add(const Key &k, const Value &v) {
+            if (!levels.empty()) {
+                const Leaf &last = leaf(levels[0].page);
+                if (!(last.keys[last.h.count - 1] < k)) throw std::runtime_error("bulk load keys out of order");
+            }
+            if (levels.empty() || head(levels[0].page).count == leafFill) {
+                Level fresh;
+                fresh.page = file.pinNew(slot, fresh.id);
+                head(fresh.page).leaf = 1;
+                if (!levels.empty()) {
+                    head(levels[0].page).next = fresh.id;
+                    levels[0].page.markDirty();
+                    push(1, k, levels[0].id, fresh.id);
+                    levels[0] = std::move(fresh);
+                } else {
+                    levels.push_back(std::move(fresh));
+                }
+            }
+            Leaf &l = leaf(levels[0].page);
+            l.keys[l.h.count] = k; l.vals[l.h.count] = v; ++l.h.count;
+            levels[0].page.markDirty();
+        }
+
+        PageId finish() {
+            PageId root = levels.empty() ? kNullPage : levels.back().id;
+            levels.clear();
+            return root;
+        }
+
+      private:
+        struct Level {
+            PageRef page;
+            PageId id = kNullPage;
+        };
+
+        // Adds child `right` with separator sep at height h, whose current
+        // node (or, for a new top level, `left`) precedes it.
+        void push(std::size_t h, const Key &sep, PageId left, PageId right) {
+            if (h == levels.size()) {
+                Level top;
+                top.page = file.pinNew(slot, top.id);
+                Inner &n = inner(top.page);
+                n.h.count = 1; n.keys[0] = sep; n.kids[0] = left; n.kids[1] = right;
+                levels.push_back(std::move(top));
+                return;
+            }
+            Inner &n = inner(levels[h].page);
+            if (n.h.count < innerFill) {
+                n.keys[n.h.count] = sep; n.kids[++n.h.count] = right;
+                levels[h].page.markDirty();
+                return;
+            }
+            // full: right starts a new node and sep moves up
+            Level fresh;
+            fresh.page = file.pinNew(slot, fresh.id);
+            inner(fresh.page).kids[0] = right;
+            push(h + 1, sep, levels[h].id, fresh.id);
+            levels[h] = std::move(fresh);
+        }
+
+        Segment &file;
+        int slot;
+        int leafFill, innerFill;
+        std::vector<Level> levels; // [0] is the current leaf
+    };
+
+    // Appends the pages of the subtree under id to out.
+    void collect(PageId id, std::vector<PageId> &out) const {
+        if (id == kNullPage) return;
+        out.push_back(id);
+        PageRef p = file.pin(id);
+        if (head(p).leaf) return;
+        for (int i = 0; i <= head(p).count; ++i) collect(inner(p).kids[i], out);
+    }
+
+    struct Split {
+        Key key{};
+        PageId page = kNullPage;
+    };
+
+    static int leafPos(const Leaf &l, const Key &k) {
+        return int(std::lower_bound(l.keys, l.keys + l.h.count, k) - l.keys);
+    }
+    static int childPos(const Inner &n, const Key &k) {
+        return int(std::upper_bound(n.keys, n.keys + n.h.count, k) - n.keys);
+    }
+
+    // Pins the leaf that would hold k; empty if the tree is empty.
+    PageRef descend(const Key &k) const {
+        PageId id = file.root(slot);
+        if (id == kNullPage) return PageRef();
+        PageRef p = file.pin(id);
+        while (!head(p).leaf) p = file.pin(inner(p).kids[childPos(inner(p), k)]);
+        return p;
+    }
+
+    // Recursive insert below page id. If the node splits, the separator and
+    // the new right sibling are reported through up.
+    bool insertAt(PageId id, const Key &k, const Value &v, Split &up) {
+        PageRef p = file.pin(id);
+        if (head(p).leaf) {
+            Leaf &l = leaf(p);
+            int i = leafPos(l, k);
+            if (i < l.h.count && !(k < l.keys[i])) return false;
+            int n = l.h.count;
+            p.markDirty();
+            if (n < kLeafCap) {
+                std::memmove(&l.keys[i + 1], &l.keys[i], (n - i) * sizeof(Key));
+                std::memmove(&l.vals[i + 1], &l.vals[i], (n - i) * sizeof(Value));
+                l.keys[i] = k; l.vals[i] = v; ++l.h.count;
+                return true;
+            }
+            // full: spread the cap+1 entries over this leaf and a new sibling
+            std::array<Key, kLeafCap + 1> ks;
+            std::array<Value, kLeafCap + 1> vs;
+            std::copy(l.keys, l.keys + i, ks.begin());
+            std::copy(l.vals, l.vals + i, vs.begin());
+            ks[i] = k; vs[i] = v;
+            std::copy(l.keys + i, l.keys + n, ks.begin() + i + 1);
+            std::copy(l.vals + i, l.vals + n, vs.begin() + i + 1);
+            int left = (n + 1) / 2, right = n + 1 - left;
+            PageId rid;
+            PageRef r = file.pinNew(slot, rid);
+            Leaf &rl = leaf(r);
+            rl.h.leaf = 1; rl.h.count = right; rl.h.next = l.h.next;
+            std::copy(ks.begin() + left, ks.end(), rl.keys);
+            std::copy(vs.begin() + left, vs.end(), rl.vals);
+            l.h.count = left; l.h.next = rid;
+            std::copy(ks.begin(), ks.begin() + left, l.keys);
+            std::copy(vs.begin(), vs.begin() + left, l.vals);
+            up.key = rl.keys[0]; up.page = rid;
+            return true;
+        }
+
+        int c = childPos(inner(p), k);
+        Split child;
+        bool inserted = insertAt(inner(p).kids[c], k, v, child);
+        if (child.page == kNullPage) return inserted;
+        Inner &in = inner(p);
+        int n = in.h.count;
+        p.markDirty();
+        if (n < kInnerCap) {
+            std::memmove(&in.keys[c + 1], &in.keys[c], (n - c) * sizeof(Key));
+            std::memmove(&in.kids[c + 2], &in.kids[c + 1], (n - c) * sizeof(PageId));
+            in.keys[c] = child.key; in.kids[c + 1] = child.page; ++in.h.count;
+            return inserted;
+        }
+        std::array<Key, kInnerCap + 1> ks;
+        std::array<PageId, kInnerCap + 2> cs;
+        std::copy(in.keys, in.keys + c, ks.begin());
+        ks[c] = child.key;
+        std::copy(in.keys + c, in.keys + n, ks.begin() + c + 1);
+        std::copy(in.kids, in.kids + c + 1, cs.begin());
+        cs[c + 1] = child.page;
+        std::copy(in.kids + c + 1, in.kids + n + 1, cs.begin() + c + 2);
+        // the middle key moves up; it is kept in neither half
+        int left = (n + 1) / 2, right = n - left;
+        PageId rid;
+        PageRef r = file.pinNew(slot, rid);
+        Inner &rn = inner(r);
+        rn.h.leaf = 0; rn.h.count = right; rn.h.next = kNullPage;
+        std::copy(ks.begin() + left + 1, ks.end(), rn.keys);
+        std::copy(cs.begin() + left + 1, cs.end(), rn.kids);
+        in.h.count = left;
+        std::copy(ks.begin(), ks.begin() + left, in.keys);
+        std::copy(cs.begin(), cs.begin() + left + 1, in.kids);
+        up.key = ks[left]; up.page = rid;
+        return inserted;
+    }
+
+    Segment &file;
+    int slot;
+    bool rebuilding = false; // a rebuild is under way; not to be compacted meanwhile
+};
+
+} // namespace storage
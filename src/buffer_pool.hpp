@@ -0,0 +1,282 @@
+#pragma once
+#include <bits/stdc++.h>
+
+namespace storage {
+
+constexpr std::size_t kPageSize = 4096;
+using PageId = std::uint32_t;
+
+class BufferPool;
+
+// Anything whose pages can be cached: knows how to read a page from its
+// backing file. The pool keeps the per-source dirty page count up to date.
+class PageSource {
+  public:
+    PageSource() : sourceId(nextId()++) {}
+    virtual ~PageSource() = default;
+    PageSource(const PageSource &) = delete;
+    PageSource &operator=(const PageSource &) = delete;
+
+    // Fills buf with page id as stored on disk (zero-filled past EOF).
+    virtual void load(PageId id, void *buf) const = 0;
+
+    std::size_t dirtyPages() const { return dirty; }
+
+  private:
+    friend class BufferPool;
+    static std::uint32_t &nextId() { static std::uint32_t id = 0; return id; }
+
+    std::uint32_t sourceId;
+    mutable std::size_t dirty = 0;
+};
+
+// RAII pin on a cached page. While a PageRef is alive its frame cannot be
+// evicted and data() stays valid.
+class PageRef {
+  public:
+    PageRef() = default;
+    PageRef(PageRef &&o) noexcept : pool(o.pool), frame(o.frame), bytes(o.bytes) { o.pool = nullptr; }
+    PageRef &operator=(PageRef &&o) noexcept {
+        if (this != &o) { release(); pool = o.pool; frame = o.frame; bytes = o.bytes; o.pool = nullptr; }
+        return *this;
+    }
+    ~PageRef() { release(); }
+
+    explicit operator bool() const { return pool != nullptr; }
+    char *data() const { return bytes; }
+    inline void markDirty();
+    inline void release();
+
+  private:
+    friend class BufferPool;
+    PageRef(BufferPool *pool, std::uint32_t frame, char *bytes) : pool(pool), frame(frame), bytes(bytes) {}
+
+    BufferPool *pool = nullptr;
+    std::uint32_t frame = 0;
+    char *bytes = nullptr; // cached so that data() needs no latch
+};
+
+// Page cache shared by every data file, bounded by a byte budget.
+//
+// Unpinned clean frames sit on an LRU list and are evicted from its cold
+// end. Dirty frames are never evicted: they reach disk only through their
+// source's own write-back path (a checkpoint for logged files), after which
+// markClean() returns them to the LRU list. If a miss finds nothing to
+// evict the pool grows past its budget for the moment and overBudget()
+// tells the owners to write back.
+//
+// One latch guards the frame table, so readers on several threads (server
+// mode) can share the pool; a miss reads its page while holding it. Pinned
+// page contents are not covered: callers keep writers apart from readers.
+class BufferPool {
+  public:
+    struct Stats {
+        std::uint64_t hits = 0;
+        std::uint64_t misses = 0;
+        std::uint64_t evictions = 0;
+        std::uint64_t writeBacks = 0;
+    };
+
+    explicit BufferPool(std::size_t budgetBytes) : capacity(std::max<std::size_t>(budgetBytes / kPageSize, 16)) {}
+
+    PageRef fetch(const PageSource &src, PageId id) {
+        std::lock_guard<std::mutex> guard(latch);
+        auto it = table.find(key(src, id));
+        if (it != table.end()) {
+            ++counters.hits;
+            Frame &f = frames[it->second];
+            if (f.pins++ == 0 && !f.dirty) unlink(it->second);
+            return PageRef(this, it->second, f.data.get());
+        }
+        ++counters.misses;
+        std::uint32_t idx = grab(src, id);
+        try {
+            src.load(id, frames[idx].data.get());
+        } catch (...) {
+            forget(idx);
+            throw;
+        }
+        return PageRef(this, idx, frames[idx].data.get());
+    }
+
+    // Pins a zero-filled frame for a page that does not exist on disk yet.
+    PageRef create(const PageSource &src, PageId id) {
+        std::lock_guard<std::mutex> guard(latch);
+        auto it = table.find(key(src, id));
+        std::uint32_t idx;
+        if (it != table.end()) {
+            idx = it->second;
+            if (frames[idx].pins++ == 0 && !frames[idx].dirty) unlink(idx);
+        } else {
+            idx = grab(src, id);
+        }
+        std::memset(frames[idx].data.get(), 0, kPageSize);
+        setDirty(idx);
+        return PageRef(this, idx, frames[idx].data.get());
+    }
+
+    // Overwrites part of a cached page without dirtying it; for sources that
+    // write through to disk themselves. No-op if the page is not cached.
+    void update(const PageSource &src, PageId id, std::size_t off, const void *bytes, std::size_t n) {
+        std::lock_guard<std::mutex> guard(latch);
+        auto it = table.find(key(src, id));
+        if (it != table.end()) std::memcpy(frames[it->second].data.get() + off, bytes, n);
+    }
+
+    // Calls visit(id, data) for every dirty page of src.
+    template <class F>
+    void forEachDirty(const PageSource &src, F &&visit) const {
+        if (!src.dirty) return;
+        std::lock_guard<std::mutex> guard(latch);
+        for (const Frame &f : frames)
+            if (f.dirty && f.owner == &src) visit(f.page, static_cast<const char *>(f.data.get()));
+    }
+
+    // Declares every dirty page of src written back.
+    void markClean(const PageSource &src) {
+        if (!src.dirty) return;
+        std::lock_guard<std::mutex> guard(latch);
+        for (std::uint32_t i = 0; i < frames.size(); ++i) {
+            Frame &f = frames[i];
+            if (!f.dirty || f.owner != &src) continue;
+            f.dirty = false;
+            ++counters.writeBacks;
+            if (f.pins == 0) pushMru(i);
+        }
+        src.dirty = 0;
+        trim();
+    }
+
+    // Forgets every page of src; its pages must be clean and unpinned.
+    void drop(const PageSource &src) {
+        std::lock_guard<std::mutex> guard(latch);
+        for (std::uint32_t i = 0; i < frames.size(); ++i) {
+            Frame &f = frames[i];
+            if (f.owner != &src) continue;
+            if (f.pins == 0 && !f.dirty) unlink(i);
+            table.erase(key(src, f.page));
+            f.owner = nullptr;
+            freeFrames.push_back(i);
+        }
+        src.dirty = 0;
+    }
+
+    bool overBudget() const { return table.size() > capacity; }
+    std::size_t capacityPages() const { return capacity; }
+    std::size_t residentPages() const { return table.size(); }
+    const Stats &stats() const { return counters; }
+
+  private:
+    friend class PageRef;
+    static constexpr std::uint32_t kNone = UINT32_MAX;
+
+    struct Frame {
+        std::unique_ptr<char[]> data;
+        const PageSource *owner = nullptr;
+        PageId page = 0;
+        std::uint32_t pins = 0;
+        bool dirty = false;
+        std::uint32_t prev = kNone, next = kNone; // LRU links, clean unpinned frames only
+    };
+
+    static std::uint64_t key(const PageSource &src, PageId id) { return (std::uint64_t(src.sourceId) << 32) | id; }
+
+    // Finds a frame for (src, id): a free one, the least recently used clean
+    // one, or a brand new one if everything else is pinned or dirty.
+    std::uint32_t grab(const PageSource &src, PageId id) {
+        std::uint32_t idx;
+        if (!freeFrames.empty()) {
+            idx = freeFrames.back(); freeFrames.pop_back();
+        } else if (table.size() >= capacity && lruHead != kNone) {
+            idx = lruHead;
+            unlink(idx);
+            table.erase(key(*frames[idx].owner, frames[idx].page));
+            ++counters.evictions;
+        } else {
+            idx = std::uint32_t(frames.size());
+            frames.emplace_back();
+            frames.back().data.reset(new char[kPageSize]);
+        }
+        Frame &f = frames[idx];
+        f.owner = &src; f.page = id; f.pins = 1; f.dirty = false;
+        table.emplace(key(src, id), idx);
+        return idx;
+    }
+
+    // Returns a frame whose page could not be read to the free list.
+    void forget(std::uint32_t idx) {
+        Frame &f = frames[idx];
+        table.erase(key(*f.owner, f.page));
+        f.owner = nullptr; f.pins = 0;
+        freeFrames.push_back(idx);
+    }
+
+    // Evicts clean frames until the pool is back within budget.
+    void trim() {
+        while (table.size() > capacity && lruHead != kNone) {
+            std::uint32_t idx = lruHead;
+            unlink(idx);
+            table.erase(key(*frames[idx].owner, frames[idx].page));
+            frames[idx].owner = nullptr;
+            freeFrames.push_back(idx);
+            ++counters.evictions;
+        }
+    }
+
+    void unpin(std::uint32_t idx) {
+        std::lock_guard<std::mutex> guard(latch);
+        Frame &f = frames[idx];
+        if (--f.pins == 0 && !f.dirty) pushMru(idx);
+    }
+    void setDirty(std::uint32_t idx) {
+        Frame &f = frames[idx];
+        if (f.dirty) return;
+        f.dirty = true;
+        ++f.owner->dirty;
+    }
+
+    void pushMru(std::uint32_t idx) {
+        Frame &f = frames[idx];
+        f.prev = lruTail; f.next = kNone;
+        if (lruTail != kNone) frames[lruTail].next = idx; else lruHead = idx;
+        lruTail = idx;
+    }
+    void unlink(std::uint32_t idx) {
+        Frame &f = frames[idx];
+        if (f.prev != kNone) frames[f.prev].next = f.next; else lruHead = f.next;
+        if (f.next != kNone) frames[f.next].prev = f.prev; else lruTail = f.prev;
+        f.prev = f.next = kNone;
+    }
+
+    mutable std::mutex latch;
+    std::size_t capacity;
+    std::deque<Frame> frames;
+    std::vector<std::uint32_t> freeFrames;
+    std::unordered_map<std::uint64_t, std::uint32_t> table;
+    std::uint32_t lruHead = kNone, lruTail = kNone;
+    Stats counters;
+};
+
+inline void PageRef::markDirty() {
+    std::lock_guard<std::mutex> guard(pool->latch);
+    pool->setDirty(frame);
+}
+inline void PageRef::release() {
+    if (pool) { pool->unpin(frame); pool = nullptr; }
+}
+
+// Process-wide pool. The budget defaults to 16 MiB and can be set in MiB
+// through the BOOKSTORE_CACHE_MB environment variable.
+inline BufferPool &bufferPool() {
+    static BufferPool pool([] {
+        std::size_t mb = 16;
+        if (const char *env = std::getenv("BOOKSTORE_CACHE_MB")) {
+            long v = std::atol(env);
+            if (v > 0) mb = std::size_t(v);
+        }
+        return mb << 20;
+    }());
+    return pool;
+}
+
+} // namespace storage
@@ -0,0 +1,120 @@
+#pragma once
+#include <bits/stdc++.h>
+
+namespace storage {
+
+// A file whose appended bytes can be forced to stable storage. Every live
+// instance is registered with the process-wide Durability policy.
+class Syncable {
+  public:
+    inline Syncable();
+    inline virtual ~Syncable();
+    Syncable(const Syncable &) = delete;
+    Syncable &operator=(const Syncable &) = delete;
+
+    // fdatasync the file if anything was written since the last call.
+    virtual void sync() = 0;
+};
+
+// When the redo logs and the finance ledger are fsync'ed. Whatever the mode,
+// a crash can only lose a suffix of the commands: each command ends with a
+// marker in the tablespace redo log, recovery replays only whole commands,
+// the journal and ledger are cut back to what the replayed log covers, and
+// data files are only rewritten by checkpoints that are logged first.
+//
+// Selected by BOOKSTORE_DURABILITY:
+//   always        after every command
+//   group:N       after every N commands
+//   group:Tms     once at least T milliseconds have passed since the last
+//                 sync; checked as each command ends and, by the server,
+//                 while idle
+//   exit          only on quit / exit / end of input (the default)
+// Any other value is an error rather than a silently weaker mode.
+class Durability {
+  public:
+    enum class Mode { Always, Group, Exit };
+
+    explicit Durability(std::string_view spec) {
+        if (spec == "always") {
+            mode = Mode::Always;
+        } else if (spec.substr(0, 6) == "group:") {
+            std::string_view arg = spec.substr(6);
+            bool ms = arg.size() > 2 && arg.substr(arg.size() - 2) == "ms";
+            if (ms) arg.remove_suffix(2);
+            long v = 0;
+            auto [end, err] = std::from_chars(arg.data(), arg.data() + arg.size(), v);
+            if (err != std::errc() || end != arg.data() + arg.size() || v <= 0) invalid(spec);
+            mode = Mode::Group;
+            if (ms) interval = std::chrono::milliseconds(v); else every = v;
+        } else if (spec != "exit") {
+            invalid(spec);
+        }
+    }
+
+    Mode policy() const { return mode; }
+
+    // Call once after each command has been applied. Safe to call from
+    // several threads; syncs are serialized.
+    void commandDone() {
+        std::lock_guard<std::mutex> guard(latch);
+        switch (mode) {
+            case Mode::Always: syncLocked(); break;
+            case Mode::Group:
+                ++sinceSync;
+                if (every ? sinceSync >= every : Clock::now() - lastSync >= interval) syncLocked();
+                break;
+            case Mode::Exit: break;
+        }
+    }
+
+    // Whether group:Tms owes a sync: commands have finished since the last
+    // one and the interval is up. commandDone() only looks as a command
+    // ends, so a process that goes idle polls this and then calls syncAll().
+    bool overdue() {
+        std::lock_guard<std::mutex> guard(latch);
+        return mode == Mode::Group && !every && sinceSync && Clock::now() - lastSync >= interval;
+    }
+
+    void syncAll() {
+        std::lock_guard<std::mutex> guard(latch);
+        syncLocked();
+    }
+
+  private:
+    friend class Syncable;
+    using Clock = std::chrono::steady_clock;
+
+    [[noreturn]] static void invalid(std::string_view spec) {
+        throw std::runtime_error("BOOKSTORE_DURABILITY=" + std::string(spec) + ": expected always, group:N, group:Tms or exit");
+    }
+
+    void syncLocked() {
+        for (Syncable *f : files) f->sync();
+        sinceSync = 0;
+        lastSync = Clock::now();
+    }
+
+    std::mutex latch;
+    Mode mode = Mode::Exit;
+    long every = 0;
+    Clock::duration interval{};
+    long sinceSync = 0;
+    Clock::time_point lastSync = Clock::now();
+    std::vector<Syncable *> files;
+};
+
+inline Durability &durability() {
+    static Durability policy([] {
+        const char *env = std::getenv("BOOKSTORE_DURABILITY");
+        return std::string_view(env && *env ? env : "exit");
+    }());
+    return policy;
+}
+
+inline Syncable::Syncable() { durability().files.push_back(this); }
+inline Syncable::~Syncable() {
+    auto &files = durability().files;
+    files.erase(std::find(files.begin(), files.end(), this));
+}
+
+} // namespace storage
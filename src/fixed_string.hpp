@@ -0,0 +1,32 @@
+#pragma once
+#include <bits/stdc++.h>
+
+namespace storage {
+
+// Inline, zero-padded string of at most N bytes. Trivially copyable so it can
+// live directly inside on-disk pages; ordering matches std::string ordering
+// for strings without embedded NULs (all spec-legal strings qualify).
+template <std::size_t N>
+struct FixedString {
+    char data[N] = {};
+
+    FixedString() = default;
+    FixedString(std::string_view s) { assign(s); }
+    FixedString(const char *s) { assign(s); }
+
+    void assign(std::string_view s) {
+        std::size_t n = std::min(s.size(), N);
+        std::memcpy(data, s.data(), n);
+        std::memset(data + n, 0, N - n);
+    }
+
+    std::size_t size() const { return strnlen(data, N); }
+    std::string_view view() const { return std::string_view(data, size()); }
+    std::string str() const { return std::string(view()); }
+
+    friend bool operator<(const FixedString &a, const FixedString &b) { return std::memcmp(a.data, b.data, N) < 0; }
+    friend bool operator==(const FixedString &a, const FixedString &b) { return std::memcmp(a.data, b.data, N) == 0; }
+    friend bool operator!=(const FixedString &a, const FixedString &b) { return !(a == b); }
+};
+
+} // namespace storage
@@ -0,0 +1,48 @@
+#pragma once
+#include <bits/stdc++.h>
+
+// Log-linear histogram of latencies in nanoseconds: eight buckets per power
+// of two, so any reported percentile is within 12.5% of the true value.
+// Fixed size (4 KiB) and O(1) to record into.
+class LatencyHistogram {
+  public:
+    void add(std::uint64_t ns) {
+        ++buckets[indexOf(ns)];
+        ++total;
+        peak = std::max(peak, ns);
+    }
+
+    std::uint64_t count() const { return total; }
+    std::uint64_t max() const { return peak; }
+
+    // Upper bound of the bucket holding the p-th percentile (0 < p <= 100).
+    std::uint64_t percentile(double p) const {
+        if (!total) return 0;
+        auto rank = std::uint64_t(std::ceil(total * p / 100));
+        std::uint64_t seen = 0;
+        for (int i = 0; i < kBuckets; ++i)
+            if ((seen += buckets[i]) >= rank) return std::min(upperBound(i), peak);
+        return peak;
+    }
+
+  private:
+    static constexpr int kSub = 8; // buckets per power of two
+    static constexpr int kBuckets = 64 * kSub;
+
+    static int indexOf(std::uint64_t v) {
+        if (v < kSub) return int(v);
+        int exp = 63 - __builtin_clzll(v); // >= 3
+        int sub = int(v >> (exp - 3)) & (kSub - 1);
+        return (exp - 2) * kSub + sub;
+    }
+    static std::uint64_t upperBound(int i) {
+        if (i < kSub) return std::uint64_t(i);
+        int exp = i / kSub + 2, sub = i % kSub;
+        std::uint64_t width = std::uint64_t(1) << (exp - 3);
+        return (kSub + sub) * width + width - 1;
+    }
+
+    std::array<std::uint64_t, kBuckets> buckets{};
+    std::uint64_t total = 0;
+    std::uint64_t peak = 0;
+};
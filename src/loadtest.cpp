@@ -0,0 +1,164 @@
+// Load-test client for server mode (code --serve PATH). Seeds a catalogue
+// through one connection, then for each client count opens that many
+// connections at once, each sending a seeded command mix, and reports
+// commands per second as the count grows.
+//
+//   loadtest --socket PATH [--clients 1,2,4,8] [--ops N] [--books N]
+//            [--read F] [--seed N]
+//
+// --ops is per client; --read is the fraction of read-only commands (show
+// and show finance), the rest split between buy and select + import. Each
+// client pipelines its whole script and reads the replies as they come, so
+// the figures measure the server rather than round trips.
+#include <bits/stdc++.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+using namespace std;
+
+namespace {
+
+struct Options {
+    string socket;
+    vector<int> clients = {1, 2, 4, 8};
+    long long ops = 20000;
+    long long books = 5000;
+    double read = 0.9;
+    unsigned long long seed = 1;
+};
+
+string isbn(long long b) { return "978-" + to_string(1000000 + b); }
+
+// The catalogue, plus a staff account the clients log in as.
+string setupScript(const Options &opt) {
+    string s = "su root sjtu\nuseradd clerk pw 3 clerk\n";
+    for (long long b = 0; b < opt.books; ++b) {
+        s += "select " + isbn(b) + "\n";
+        s += "modify -name=\"Title " + to_string(b / 4) + "\" -author=\"Author " + to_string(b % 997) +
+             "\" -keyword=\"kw" + to_string(b % 100) + "\" -price=" + to_string(1 + b % 200) + ".50\n";
+        s += "import 1000 1.00\n";
+    }
+    return s + "quit\n";
+}
+
+string clientScript(const Options &opt, unsigned long long seed, long long &commands) {
+    mt19937_64 rng(seed);
+    auto pick = [&](long long lo, long long hi) { return uniform_int_distribution<long long>(lo, hi)(rng); };
+    auto coin = [&] { return uniform_real_distribution<double>(0, 1)(rng); };
+    string s = "su clerk pw\n";
+    commands = 1;
+    for (long long i = 0; i < opt.ops; ++i, ++commands) {
+        long long b = pick(0, opt.books - 1);
+        if (coin() < opt.read) {
+            double r = coin();
+            if (r < 0.6) s += "show -ISBN=" + isbn(b) + "\n";
+            else if (r < 0.8) s += "show -author=\"Author " + to_string(b % 997) + "\"\n";
+            else s += "show -keyword=kw" + to_string(b % 100) + "\n";
+        } else if (coin() < 0.5) {
+            s += "buy " + isbn(b) + " " + to_string(pick(1, 3)) + "\n";
+        } else {
+            s += "select " + isbn(b) + "\nimport " + to_string(pick(1, 10)) + " 1.00\n";
+            ++commands;
+        }
+    }
+    return s + "quit\n";
+}
+
+int connectTo(const string &path) {
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    if (path.size() >= sizeof addr.sun_path) return -1;
+    memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+    int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd >= 0 && ::connect(fd, reinterpret_cast<sockaddr *>(&addr), sizeof addr) != 0) { ::close(fd); return -1; }
+    return fd;
+}
+
+// Sends script and reads replies until the server closes the connection;
+// returns the number of reply bytes, or -1 on error.
+long long converse(const string &path, const string &script) {
+    int fd = connectTo(path);
+    if (fd < 0) return -1;
+    size_t sent = 0;
+    long long received = 0;
+    vector<char> buf(1 << 16);
+    for (;;) {
+        pollfd p{fd, short(POLLIN | (sent < script.size() ? POLLOUT : 0)), 0};
+        if (::poll(&p, 1, -1) < 0) { if (errno == EINTR) continue; break; }
+        if (p.revents & POLLIN || p.revents & POLLHUP) {
+            ssize_t n = ::read(fd, buf.data(), buf.size());
+            if (n <= 0) break;
+            received += n;
+        }
+        if (p.revents & POLLOUT) {
+            ssize_t n = ::send(fd, script.data() + sent, script.size() - sent, MSG_NOSIGNAL | MSG_DONTWAIT);
+            if (n > 0) sent += size_t(n);
+            else if (n < 0 && errno != EAGAIN && errno != EINTR) break;
+        }
+    }
+    ::close(fd);
+    return sent == script.size() ? received : -1;
+}
+
+bool parse(int argc, char **argv, Options &opt) {
+    for (int i = 1; i < argc; ++i) {
+        string a = argv[i];
+        if (i + 1 >= argc) return false;
+        string v = argv[++i];
+        if (a == "--socket") opt.socket = v;
+        else if (a == "--ops") opt.ops = atoll(v.c_str());
+        else if (a == "--books") opt.books = atoll(v.c_str());
+        else if (a == "--read") opt.read = atof(v.c_str());
+        else if (a == "--seed") opt.seed = strtoull(v.c_str(), nullptr, 10);
+        else if (a == "--clients") {
+            opt.clients.clear();
+            stringstream ss(v);
+            for (string n; getline(ss, n, ',');) opt.clients.push_back(atoi(n.c_str()));
+        } else return false;
+    }
+    for (int c : opt.clients)
+        if (c <= 0) return false;
+    return !opt.socket.empty() && !opt.clients.empty() && opt.ops >= 0 && opt.books > 0;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+    Options opt;
+    if (!parse(argc, argv, opt)) {
+        cerr << "usage: loadtest --socket PATH [--clients 1,2,4,8] [--ops N] [--books N] [--read F] [--seed N]\n";
+        return 2;
+    }
+    using Clock = chrono::steady_clock;
+    auto t0 = Clock::now();
+    if (converse(opt.socket, setupScript(opt)) < 0) {
+        cerr << "loadtest: cannot talk to " << opt.socket << '\n';
+        return 1;
+    }
+    printf("setup %.3f s (%lld books)\n\n", chrono::duration<double>(Clock::now() - t0).count(), opt.books);
+    printf("%8s %12s %10s %12s %12s\n", "clients", "commands", "seconds", "commands/s", "reply KiB");
+
+    for (int n : opt.clients) {
+        vector<string> scripts(n);
+        long long commands = 0;
+        for (int i = 0; i < n; ++i) {
+            long long c;
+            scripts[i] = clientScript(opt, opt.seed * 1000003 + i, c);
+            commands += c;
+        }
+        vector<long long> replies(n);
+        auto start = Clock::now();
+        vector<thread> threads;
+        for (int i = 0; i < n; ++i) threads.emplace_back([&, i] { replies[i] = converse(opt.socket, scripts[i]); });
+        for (auto &t : threads) t.join();
+        double secs = chrono::duration<double>(Clock::now() - start).count();
+        long long bytes = 0;
+        for (long long r : replies) {
+            if (r < 0) { cerr << "loadtest: a client lost its connection\n"; return 1; }
+            bytes += r;
+        }
+        printf("%8d %12lld %10.3f %12.0f %12.1f\n", n, commands, secs, commands / max(secs, 1e-9), bytes / 1024.0);
+    }
+    return 0;
+}
@@ -0,0 +1,97 @@
+#pragma once
+#include <bits/stdc++.h>
+
+// Writes v / 100 with exactly two decimals (e.g. -1234 -> "-12.34") into
+// buf, which must hold at least 44 bytes; returns one past the last char.
+inline char *formatCents(__int128 v, char *buf) {
+    char tmp[44];
+    int n = 0;
+    bool neg = v < 0;
+    unsigned __int128 u = neg ? -(unsigned __int128)v : (unsigned __int128)v;
+    do { tmp[n++] = char('0' + int(u % 10)); u /= 10; } while (u || n < 3);
+    char *p = buf;
+    if (neg) *p++ = '-';
+    while (n > 2) *p++ = tmp[--n];
+    *p++ = '.';
+    *p++ = tmp[1];
+    *p++ = tmp[0];
+    return p;
+}
+
+// Monetary amount held as an integer number of cents. Prices and single
+// transaction amounts fit comfortably in 64 bits; running totals use
+// MoneyTotal instead.
+class Money {
+  public:
+    constexpr Money() = default;
+    static constexpr Money fromCents(std::int64_t c) { Money m; m.value = c; return m; }
+    constexpr std::int64_t cents() const { return value; }
+
+    // Parses digits with at most one '.', e.g. "12", "12.5", ".50". Digits
+    // past the second decimal are rounded half-up. At most 15 integer
+    // digits are accepted.
+    static bool parse(std::string_view s, Money &out) {
+        std::int64_t whole = 0, frac = 0;
+        int intDigits = 0, fracDigits = 0;
+        bool dot = false, roundUp = false;
+        for (char c : s) {
+            if (c == '.') {
+                if (dot) return false;
+                dot = true;
+            } else if (c >= '0' && c <= '9') {
+                if (!dot) {
+                    if (++intDigits > 15) return false;
+                    whole = whole * 10 + (c - '0');
+                } else if (fracDigits < 2) {
+                    frac = frac * 10 + (c - '0'); ++fracDigits;
+                } else if (fracDigits++ == 2) {
+                    roundUp = c >= '5';
+                }
+            } else {
+                return false;
+            }
+        }
+        if (intDigits + fracDigits == 0) return false;
+        while (fracDigits < 2) { frac *= 10; ++fracDigits; }
+        out.value = whole * 100 + frac + (roundUp ? 1 : 0);
+        return true;
+    }
+
+    // qty * *this, failing instead of wrapping on overflow.
+    bool mul(std::int64_t qty, Money &out) const {
+        std::int64_t r;
+        if (__builtin_mul_overflow(value, qty, &r)) return false;
+        out.value = r;
+        return true;
+    }
+
+    char *format(char *buf) const { return formatCents(value, buf); }
+
+    friend Money operator+(Money a, Money b) { return fromCents(a.value + b.value); }
+    friend Money operator-(Money a, Money b) { return fromCents(a.value - b.value); }
+    friend bool operator==(Money a, Money b) { return a.value == b.value; }
+    friend bool operator!=(Money a, Money b) { return a.value != b.value; }
+    friend bool operator<(Money a, Money b) { return a.value < b.value; }
+    friend bool operator<=(Money a, Money b) { return a.value <= b.value; }
+
+    friend std::ostream &operator<<(std::ostream &os, Money m) {
+        char buf[44];
+        return os.write(buf, m.format(buf) - buf);
+    }
+
+  private:
+    std::int64_t value = 0;
+};
+
+// 128-bit accumulator for sums over arbitrarily many transactions.
+struct MoneyTotal {
+    __int128 cents = 0;
+
+    MoneyTotal &operator+=(Money m) { cents += m.cents(); return *this; }
+    friend MoneyTotal operator-(MoneyTotal a, MoneyTotal b) { return MoneyTotal{a.cents - b.cents}; }
+
+    friend std::ostream &operator<<(std::ostream &os, MoneyTotal t) {
+        char buf[44];
+        return os.write(buf, formatCents(t.cents, buf) - buf);
+    }
+};
@@ -0,0 +1,79 @@
+#pragma once
+#include <bits/stdc++.h>
+#include <unistd.h>
+#include "money.hpp"
+
+// Large reusable output buffer written to a file descriptor in big chunks.
+// Numbers and money are formatted straight into the buffer. Once a write
+// fails (e.g. times out on a socket), the rest of the output is discarded.
+class OutputBuffer {
+  public:
+    explicit OutputBuffer(int fd, std::size_t capacity = 1 << 16) : fd(fd), buf(new char[capacity]), cap(capacity) {}
+    ~OutputBuffer() { flush(); }
+
+    OutputBuffer(const OutputBuffer &) = delete;
+    OutputBuffer &operator=(const OutputBuffer &) = delete;
+
+    OutputBuffer &operator<<(char c) {
+        if (len == cap) flush();
+        buf[len++] = c;
+        return *this;
+    }
+    OutputBuffer &operator<<(std::string_view s) {
+        if (s.size() > cap - len) {
+            flush();
+            if (s.size() > cap) { writeAll(s.data(), s.size()); return *this; }
+        }
+        std::memcpy(buf.get() + len, s.data(), s.size());
+        len += s.size();
+        return *this;
+    }
+    OutputBuffer &operator<<(const char *s) { return *this << std::string_view(s); }
+    OutputBuffer &operator<<(long long v) {
+        char *p = reserve(24), tmp[24];
+        unsigned long long u = v < 0 ? 0ULL - (unsigned long long)v : (unsigned long long)v;
+        int n = 0;
+        do { tmp[n++] = char('0' + u % 10); u /= 10; } while (u);
+        if (v < 0) *p++ = '-';
+        while (n) *p++ = tmp[--n];
+        return commit(p);
+    }
+    OutputBuffer &operator<<(Money m) { return commit(m.format(reserve(44))); }
+    OutputBuffer &operator<<(MoneyTotal t) { return commit(formatCents(t.cents, reserve(44))); }
+
+    void flush() {
+        if (len) writeAll(buf.get(), len);
+        len = 0;
+    }
+
+    // Bytes handed to the file descriptor so far.
+    std::uint64_t bytesWritten() const { return written; }
+    // Whether a write has failed, so that output is being discarded.
+    bool failed() const { return broken; }
+
+  private:
+    // Room for n more bytes; commit() with the new end once written.
+    char *reserve(std::size_t n) {
+        if (cap - len < n) flush();
+        return buf.get() + len;
+    }
+    OutputBuffer &commit(char *end) {
+        len = std::size_t(end - buf.get());
+        return *this;
+    }
+
+    void writeAll(const char *p, std::size_t n) {
+        while (n && !broken) {
+            ssize_t w = ::write(fd, p, n);
+            if (w < 0) { if (errno == EINTR) continue; broken = true; return; }
+            p += w; n -= std::size_t(w); written += std::uint64_t(w);
+        }
+    }
+
+    int fd;
+    std::unique_ptr<char[]> buf;
+    std::size_t cap;
+    std::size_t len = 0;
+    std::uint64_t written = 0;
+    bool broken = false;
+};
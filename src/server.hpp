@@ -0,0 +1,180 @@
+#pragma once
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include "bookstore.hpp"
+
+// Multi-client server mode (code --serve PATH). Clients connect to a Unix
+// domain socket and speak the stdin protocol: one command per line, output
+// in the same form, and quit / exit or closing the connection ends only
+// that client. Each client has its own Session, so its own login and
+// selection stacks; the shared LoginTable keeps delete from removing an
+// account logged in elsewhere.
+//
+// The stores are shared under one reader-writer lock. Read-only commands
+// (show, show finance, su, logout, log, report) hold it shared and run
+// concurrently; every other command holds it exclusive, so e.g. the stock
+// check and decrement of buy are one atomic step. Each client's commands
+// run in the order sent. A command's output goes into the client's own
+// kBufferBytes buffer, which is written out whenever it fills (lock held or
+// not) and whenever the client's buffered input runs dry; so a listing as
+// long as `show` of the whole catalogue costs each client no more memory
+// than that. A write waits at most kSendTimeout for a client that is not
+// reading; one that times out is disconnected, which bounds how long such
+// a client can hold the lock.
+//
+// SIGINT or SIGTERM stops the server: clients finish their current command
+// and their connections are shut down (which also ends a write blocked on
+// a client that is not reading), then the stores close and checkpoint as
+// usual.
+class Server {
+  public:
+    Server(AccountDB &adb, BookDB &bdb, FinanceDB &fdb, JournalDB &journal, string path)
+        : adb(adb), bdb(bdb), fdb(fdb), journal(journal), path(std::move(path)) {}
+
+    // Serves until SIGINT or SIGTERM.
+    void run() {
+        listen();
+        struct sigaction sa{};
+        sa.sa_handler = [](int) { stopping = true; };
+        sigaction(SIGINT, &sa, nullptr);
+        sigaction(SIGTERM, &sa, nullptr);
+        signal(SIGPIPE, SIG_IGN); // a vanished client must not kill the server
+
+        while (!stopping) {
+            reap();
+            syncOverdue();
+            if (!waitReadable(listener)) continue;
+            int fd = ::accept(listener, nullptr, nullptr);
+            if (fd < 0) continue;
+            auto client = make_unique<Client>();
+            Client &c = *client;
+            c.fd = fd;
+            ::setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &kSendTimeout, sizeof kSendTimeout);
+            c.worker = thread([this, fd, &c] {
+                try {
+                    serve(fd);
+                } catch (const exception &e) {
+                    // a store failed mid-command; stop rather than serve from it
+                    cerr << "bookstore: " << e.what() << '\n';
+                    stopping = true;
+                }
+                c.done = true;
+            });
+            clients.push_back(std::move(client));
+        }
+        for (auto &c : clients) ::shutdown(c->fd, SHUT_RDWR);
+        for (auto &c : clients) { c->worker.join(); ::close(c->fd); }
+        clients.clear();
+        ::close(listener);
+        ::unlink(path.c_str());
+    }
+
+  private:
+    static constexpr size_t kBufferBytes = 1 << 16; // output buffered per client
+    static constexpr timeval kSendTimeout = {1, 0};   // per write to a client
+
+    // The connection is closed by the accepting thread once the worker has
+    // been joined, so that shutting it down on stop never hits a reused fd.
+    struct Client {
+        int fd = -1;
+        thread worker;
+        atomic<bool> done{false};
+    };
+
+    void listen() {
+        sockaddr_un addr{};
+        addr.sun_family = AF_UNIX;
+        if (path.size() >= sizeof addr.sun_path) throw runtime_error("socket path too long: " + path);
+        memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+        struct stat st;
+        if (::stat(path.c_str(), &st) == 0 && S_ISSOCK(st.st_mode)) ::unlink(path.c_str()); // stale
+        listener = ::socket(AF_UNIX, SOCK_STREAM, 0);
+        if (listener < 0) throw runtime_error("cannot create socket");
+        if (::bind(listener, reinterpret_cast<sockaddr *>(&addr), sizeof addr) != 0 || ::listen(listener, 64) != 0) {
+            ::close(listener);
+            throw runtime_error("cannot listen on " + path);
+        }
+    }
+
+    // Joins the threads of clients that have disconnected.
+    void reap() {
+        for (auto it = clients.begin(); it != clients.end();) {
+            if ((*it)->done) { (*it)->worker.join(); ::close((*it)->fd); it = clients.erase(it); }
+            else ++it;
+        }
+    }
+
+    // Keeps the group:Tms promise after a burst of commands: the loop
+    // wakes at least every 100 ms. Writers are held off so that no append
+    // is under way while the files sync.
+    void syncOverdue() {
+        if (!storage::durability().overdue()) return;
+        shared_lock<shared_mutex> guard(storeLock);
+        storage::durability().syncAll();
+    }
+
+    void serve(int fd) {
+        Session session;
+        OutputBuffer out(fd, kBufferBytes);
+        Context ctx{adb, bdb, fdb, journal, session, out};
+        ctx.logins = &logins;
+        ParsedCommand cmd;
+        string pending;
+        vector<char> buf(1 << 16);
+        bool eof = false;
+        while (ctx.running && !stopping && !out.failed()) {
+            size_t start = 0;
+            for (size_t nl; ctx.running && !out.failed() && (nl = pending.find('\n', start)) != string::npos; start = nl + 1) {
+                cmd.line.assign(pending, start, nl - start);
+                run(ctx, cmd);
+            }
+            pending.erase(0, start);
+            if (eof) {
+                if (ctx.running && !out.failed() && !pending.empty()) { cmd.line = pending; run(ctx, cmd); } // no trailing newline
+                break;
+            }
+            out.flush();
+            if (!ctx.running || !waitReadable(fd)) continue;
+            ssize_t n = ::read(fd, buf.data(), buf.size());
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) eof = true;
+            else pending.append(buf.data(), size_t(n));
+        }
+        for (const Account &a : session.stack) logins.remove(a.userId.view());
+        out.flush();
+        ::shutdown(fd, SHUT_RDWR); // the client sees the end now; the fd is closed once reaped
+    }
+
+    void run(Context &ctx, ParsedCommand &cmd) {
+        parse(cmd);
+        if (!cmd.entry || cmd.entry->readOnly) { // unknown commands only print Invalid
+            shared_lock<shared_mutex> guard(storeLock);
+            execute(ctx, cmd);
+        } else {
+            unique_lock<shared_mutex> guard(storeLock);
+            execute(ctx, cmd);
+        }
+    }
+
+    // Waits up to 100 ms for fd to become readable, so that loops notice a
+    // stop request.
+    static bool waitReadable(int fd) {
+        pollfd p{fd, POLLIN, 0};
+        return ::poll(&p, 1, 100) > 0;
+    }
+
+    static inline atomic<bool> stopping{false}; // lock-free, so the signal handler may set it
+
+    AccountDB &adb;
+    BookDB &bdb;
+    FinanceDB &fdb;
+    JournalDB &journal;
+    string path;
+    int listener = -1;
+    shared_mutex storeLock;
+    LoginTable logins;
+    vector<unique_ptr<Client>> clients;
+};
@@ -0,0 +1,231 @@
+#pragma once
+#include "bookstore.hpp"
+
+// Offline snapshots of a whole store (code --export FILE / --import FILE),
+// for seeding a store or restoring one. A snapshot is a header followed by
+// four sections of fixed-width records:
+//   accounts      Account, in ascending UserID order
+//   books         Book, in ascending ISBN order
+//   transactions  income and expenditure of each finance transaction
+//   journal       JournalDB::Entry, in order, each naming its book by the
+//                 book's place in the books section (counting from 1)
+// The header holds a magic tag, the format version, the record count of
+// each section and a crc32 of everything after it. Export streams each
+// table in its own order into FILE.tmp, which is renamed over FILE once
+// complete and synced.
+//
+// Import reads the whole file to check it first, then builds the account
+// and book trees bottom-up from the sorted sections and appends the ledger
+// and journal in large sequential writes; the tallies are bumped from the
+// journal entries as record() does. Books are numbered in the order of
+// their section, so the journal's book numbers are the new BookIds as they
+// stand. Nothing goes through the redo log, so the store must be empty (as
+// on first run), and an interrupted import leaves a partial store that has
+// to be deleted before trying again.
+namespace snapshot {
+
+struct Transaction {
+    int64_t incomeCents;
+    int64_t expendCents;
+};
+
+struct Header {
+    char magic[8];
+    uint32_t version;
+    uint32_t checksum; // crc32 of the sections
+    uint64_t accounts, books, transactions, journal; // records per section
+};
+
+constexpr char kMagic[8] = {'B', 'K', 'S', 'N', 'A', 'P', '0', '1'};
+constexpr uint32_t kVersion = 2;
+constexpr size_t kChunk = 1 << 20;
+
+// Buffered sequential writer that checksums what passes through it.
+class Writer {
+  public:
+    explicit Writer(const string &path) : path(path), io(stats::io(path)), buf(new char[kChunk]) {
+        fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0) throw runtime_error("cannot create " + path);
+        Header blank{};
+        put(&blank, sizeof blank);
+    }
+    ~Writer() { if (fd >= 0) ::close(fd); }
+    Writer(const Writer &) = delete;
+    Writer &operator=(const Writer &) = delete;
+
+    template <class T>
+    void add(const T &record) {
+        static_assert(is_trivially_copyable_v<T>);
+        crc = storage::crc32(&record, sizeof record, crc);
+        put(&record, sizeof record);
+    }
+
+    // Writes the header over the placeholder and syncs the file.
+    void finish(Header h) {
+        flush();
+        memcpy(h.magic, kMagic, sizeof kMagic);
+        h.version = kVersion;
+        h.checksum = crc;
+        if (::pwrite(fd, &h, sizeof h, 0) != (ssize_t)sizeof h) throw runtime_error("cannot write " + path);
+        stats::write(io, sizeof h);
+        ::fdatasync(fd);
+        stats::sync(io);
+    }
+
+  private:
+    void put(const void *p, size_t n) {
+        if (len + n > kChunk) flush();
+        memcpy(buf.get() + len, p, n);
+        len += n;
+    }
+    void flush() {
+        if (!len) return;
+        if (::write(fd, buf.get(), len) != (ssize_t)len) throw runtime_error("cannot write " + path);
+        stats::write(io, len);
+        len = 0;
+    }
+
+    string path;
+    int fd = -1;
+    stats::Io *io;
+    unique_ptr<char[]> buf;
+    size_t len = 0;
+    uint32_t crc = 0;
+};
+
+// Reads a snapshot: check() validates it, then each section can be
+// streamed any number of times.
+class Reader {
+  public:
+    explicit Reader(const string &path) : path(path), io(stats::io(path)), buf(new char[kChunk]) {
+        fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) throw runtime_error("cannot open " + path);
+    }
+    ~Reader() { if (fd >= 0) ::close(fd); }
+    Reader(const Reader &) = delete;
+    Reader &operator=(const Reader &) = delete;
+
+    // Validates the header, the file size and the checksum.
+    const Header &check() {
+        if (::pread(fd, &head, sizeof head, 0) != (ssize_t)sizeof head) throw runtime_error(path + ": truncated snapshot");
+        stats::read(io, sizeof head);
+        if (memcmp(head.magic, kMagic, sizeof kMagic) != 0) throw runtime_error(path + ": not a bookstore snapshot");
+        if (head.version != kVersion) throw runtime_error(path + ": unsupported snapshot version");
+        off_t end = ::lseek(fd, 0, SEEK_END);
+        if (end != offsetOf(4)) throw runtime_error(path + ": snapshot size does not match its header");
+        uint32_t crc = 0;
+        read(sizeof head, end, [&](const char *p, size_t n) { crc = storage::crc32(p, n, crc); });
+        if (crc != head.checksum) throw runtime_error(path + ": snapshot checksum mismatch");
+        return head;
+    }
+
+    template <class F> void accounts(F &&visit) const { section<Account>(0, visit); }
+    template <class F> void books(F &&visit) const { section<Book>(1, visit); }
+    template <class F> void transactions(F &&visit) const { section<Transaction>(2, visit); }
+    template <class F> void journal(F &&visit) const { section<JournalDB::Entry>(3, visit); }
+
+  private:
+    static constexpr size_t kSizes[4] = {sizeof(Account), sizeof(Book), sizeof(Transaction), sizeof(JournalDB::Entry)};
+
+    uint64_t count(int s) const {
+        const uint64_t counts[4] = {head.accounts, head.books, head.transactions, head.journal};
+        return counts[s];
+    }
+    // Offset of section s; offsetOf(4) is the end of the file.
+    off_t offsetOf(int s) const {
+        off_t off = sizeof(Header);
+        for (int i = 0; i < s; ++i) off += off_t(count(i) * kSizes[i]);
+        return off;
+    }
+
+    // Calls visit(bytes, n) for consecutive pieces of [from, to), each a
+    // whole number of `unit`-byte records.
+    template <class F>
+    void read(off_t from, off_t to, F &&visit, size_t unit = 1) const {
+        size_t step = kChunk / unit * unit;
+        while (from < to) {
+            size_t n = size_t(min<off_t>(to - from, off_t(step)));
+            if (::pread(fd, buf.get(), n, from) != (ssize_t)n) throw runtime_error(path + ": snapshot read failed");
+            stats::read(io, n);
+            visit(buf.get(), n);
+            from += off_t(n);
+        }
+    }
+
+    template <class T, class F>
+    void section(int s, F &visit) const {
+        read(offsetOf(s), offsetOf(s + 1), [&](const char *p, size_t n) {
+            for (size_t i = 0; i < n; i += sizeof(T)) {
+                T record;
+                memcpy(&record, p + i, sizeof record);
+                visit(record);
+            }
+        }, sizeof(T));
+    }
+
+    string path;
+    int fd = -1;
+    stats::Io *io;
+    unique_ptr<char[]> buf;
+    Header head{};
+};
+
+inline void exportTo(const string &path, const AccountDB &adb, const BookDB &bdb, const FinanceDB &fdb, const JournalDB &journal) {
+    string tmp = path + ".tmp";
+    {
+        Writer out(tmp);
+        Header h{};
+        adb.forEach([&](const Account &a) { out.add(a); ++h.accounts; });
+        vector<BookId> place(bdb.size() + 1, kNoBook); // by BookId
+        bdb.forEach([&](const BookRow &r) {
+            out.add(Book{r.isbn, r.name, r.author, r.keyword, r.stock, r.price});
+            place[r.id] = BookId(++h.books);
+        });
+        fdb.forEach([&](Money income, Money expend) {
+            out.add(Transaction{income.cents(), expend.cents()});
+            ++h.transactions;
+        });
+        journal.forEach([&](long long, JournalDB::Entry e) {
+            if (e.book != kNoBook) e.book = place[e.book];
+            out.add(e);
+            ++h.journal;
+        });
+        out.finish(h);
+    }
+    if (::rename(tmp.c_str(), path.c_str()) != 0) throw runtime_error("cannot rename " + tmp + " to " + path);
+}
+
+inline void importFrom(const string &path, AccountDB &adb, BookDB &bdb, FinanceDB &fdb, JournalDB &journal) {
+    Reader in(path);
+    const Header &h = in.check();
+    if (adb.size() > 1 || bdb.size() || fdb.size() || journal.size())
+        throw runtime_error("import needs an empty store");
+    // the trees are built straight from the sections, so their keys must
+    // already be in order
+    bool sorted = true;
+    optional<storage::FixedString<30>> lastUser;
+    in.accounts([&](const Account &a) { sorted &= !lastUser || *lastUser < a.userId; lastUser = a.userId; });
+    optional<storage::FixedString<20>> lastIsbn;
+    in.books([&](const Book &b) { sorted &= !lastIsbn || *lastIsbn < b.isbn; lastIsbn = b.isbn; });
+    if (!sorted) throw runtime_error(path + ": snapshot records out of order");
+    // each buy or import in the journal is one finance transaction, of a
+    // book in the books section
+    uint64_t transfers = 0;
+    bool known = true;
+    in.journal([&](const JournalDB::Entry &e) {
+        bool transfer = e.action == JournalDB::kBuy || e.action == JournalDB::kImport;
+        transfers += transfer;
+        known &= !transfer || (e.book != kNoBook && e.book <= h.books);
+    });
+    if (transfers != h.transactions) throw runtime_error(path + ": journal and finance sections disagree");
+    if (!known) throw runtime_error(path + ": journal names a book not in the snapshot");
+
+    adb.bulkLoad([&](auto &&add) { in.accounts(add); });
+    bdb.bulkLoad([&](auto &&visit) { in.books(visit); });
+    fdb.bulkAppend([&](auto &&add) {
+        in.transactions([&](const Transaction &t) { add(Money::fromCents(t.incomeCents), Money::fromCents(t.expendCents)); });
+    });
+    journal.bulkAppend([&](auto &&add) { in.journal(add); });
+}
+
+} // namespace snapshot
@@ -0,0 +1,76 @@
+#pragma once
+#include <bits/stdc++.h>
+
+// Bounded single-producer / single-consumer queue of N reusable slots. The
+// producer fills a slot in place and publishes it; the consumer reads it in
+// place and releases it. Each side touches only its own index plus an
+// acquire load of the other's, and caches that load until it runs out of
+// slots, so the queue is lock-free and mostly free of cache-line traffic.
+template <class T, std::size_t N>
+class SpscRing {
+    static_assert(N && (N & (N - 1)) == 0, "capacity must be a power of two");
+
+  public:
+    SpscRing() : slots(new T[N]) {}
+    SpscRing(const SpscRing &) = delete;
+    SpscRing &operator=(const SpscRing &) = delete;
+
+    // Producer: the next free slot, or null while the queue is full.
+    T *claim() {
+        std::size_t h = head.load(std::memory_order_relaxed);
+        if (h - tailSeen == N) {
+            tailSeen = tail.load(std::memory_order_acquire);
+            if (h - tailSeen == N) return nullptr;
+        }
+        return &slots[h & (N - 1)];
+    }
+    // Producer: hands the slot from claim() to the consumer.
+    void publish() { head.store(head.load(std::memory_order_relaxed) + 1, std::memory_order_release); }
+    // Producer: no more slots will be published.
+    void close() { closed.store(true, std::memory_order_release); }
+
+    // Consumer: the oldest published slot, or null while the queue is empty.
+    T *front() {
+        std::size_t t = tail.load(std::memory_order_relaxed);
+        if (t == headSeen) {
+            headSeen = head.load(std::memory_order_acquire);
+            if (t == headSeen) return nullptr;
+        }
+        return &slots[t & (N - 1)];
+    }
+    // Consumer: gives the slot from front() back to the producer.
+    void release() { tail.store(tail.load(std::memory_order_relaxed) + 1, std::memory_order_release); }
+    // Consumer: true once the producer has closed and every slot is consumed.
+    bool drained() {
+        if (!closed.load(std::memory_order_acquire)) return false;
+        return front() == nullptr;
+    }
+
+  private:
+    std::unique_ptr<T[]> slots;
+    alignas(64) std::atomic<std::size_t> head{0}; // written by the producer
+    std::size_t tailSeen = 0;
+    alignas(64) std::atomic<std::size_t> tail{0}; // written by the consumer
+    std::size_t headSeen = 0;
+    alignas(64) std::atomic<bool> closed{false};
+};
+
+// Waiting strategy for a side that found the ring empty or full: spin
+// briefly, then yield, then sleep, so an idle pipeline does not burn a core.
+class Backoff {
+  public:
+    void pause() {
+        if (rounds < 64) {
+            ++rounds;
+        } else if (rounds < 1024) {
+            ++rounds;
+            std::this_thread::yield();
+        } else {
+            std::this_thread::sleep_for(std::chrono::microseconds(50));
+        }
+    }
+    void reset() { rounds = 0; }
+
+  private:
+    int rounds = 0;
+};
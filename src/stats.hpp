@@ -0,0 +1,102 @@
+#pragma once
+#include <bits/stdc++.h>
+#include "buffer_pool.hpp"
+#include "histogram.hpp"
+
+// Opt-in instrumentation: per-command latency histograms, per-file I/O
+// counters and buffer pool statistics.
+//
+// Recording is switched on at run time by BOOKSTORE_STATS: "1" or "stderr"
+// dumps a summary to stderr when the program ends, any other value names a
+// file the summary is appended to. While it is unset every hook is a single
+// predictable branch. Building with BOOKSTORE_NO_STATS defined (cmake
+// -DBOOKSTORE_STATS=OFF) turns the hooks into empty inline functions.
+namespace stats {
+
+// Atomic, since server mode reads a file from several threads at once.
+struct Io {
+    std::atomic<std::uint64_t> reads{0}, readBytes{0};
+    std::atomic<std::uint64_t> writes{0}, writeBytes{0};
+    std::atomic<std::uint64_t> syncs{0};
+};
+
+#ifndef BOOKSTORE_NO_STATS
+
+inline const char *const target = std::getenv("BOOKSTORE_STATS");
+inline const bool on = target && *target;
+
+struct Registry {
+    std::map<std::string, Io, std::less<>> files; // nodes are stable
+    std::mutex commandsLatch;
+    std::map<std::string, LatencyHistogram, std::less<>> commands;
+};
+inline Registry &registry() { static Registry r; return r; }
+
+// Counters for one data file, named by its base name.
+inline Io *io(const std::string &path) {
+    if (!on) return nullptr;
+    return &registry().files[std::filesystem::path(path).filename().string()];
+}
+
+inline void read(Io *c, std::size_t n) { if (on) { ++c->reads; c->readBytes += n; } }
+inline void write(Io *c, std::size_t n) { if (on) { ++c->writes; c->writeBytes += n; } }
+inline void sync(Io *c) { if (on) ++c->syncs; }
+
+// Times one command from construction to done().
+class CommandTimer {
+  public:
+    CommandTimer() { if (on) start = std::chrono::steady_clock::now(); }
+    void done(std::string_view command) {
+        if (!on) return;
+        auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+        auto &r = registry();
+        std::lock_guard<std::mutex> guard(r.commandsLatch);
+        auto &cmds = r.commands;
+        auto it = cmds.find(command);
+        if (it == cmds.end()) it = cmds.emplace(std::string(command), LatencyHistogram()).first;
+        it->second.add(std::uint64_t(ns));
+    }
+
+  private:
+    std::chrono::steady_clock::time_point start;
+};
+
+// Writes the summary to wherever BOOKSTORE_STATS points; call once all
+// data files are closed so that their final checkpoints are counted.
+inline void report() {
+    if (!on) return;
+    std::string_view dest(target);
+    FILE *f = dest == "1" || dest == "stderr" ? stderr : std::fopen(target, "a");
+    if (!f) return;
+    auto &r = registry();
+    std::fprintf(f, "== bookstore stats ==\n%-16s %10s %10s %10s %10s\n", "command", "count", "p50 us", "p99 us", "max us");
+    for (auto &[name, h] : r.commands)
+        std::fprintf(f, "%-16s %10llu %10.1f %10.1f %10.1f\n", name.c_str(), (unsigned long long)h.count(),
+                     h.percentile(50) / 1e3, h.percentile(99) / 1e3, h.max() / 1e3);
+    std::fprintf(f, "%-16s %10s %10s %10s %10s %10s\n", "file", "reads", "read KiB", "writes", "write KiB", "syncs");
+    for (auto &[name, c] : r.files)
+        std::fprintf(f, "%-16s %10llu %10.1f %10llu %10.1f %10llu\n", name.c_str(), (unsigned long long)c.reads, double(c.readBytes) / 1024.0,
+                     (unsigned long long)c.writes, double(c.writeBytes) / 1024.0, (unsigned long long)c.syncs);
+    auto &pool = storage::bufferPool();
+    auto &s = pool.stats();
+    double lookups = double(s.hits + s.misses);
+    std::fprintf(f, "buffer pool: %llu hits, %llu misses (%.1f%% hit rate), %llu evictions, %llu write-backs, %zu / %zu pages resident\n",
+                 (unsigned long long)s.hits, (unsigned long long)s.misses, lookups ? 100.0 * s.hits / lookups : 0.0,
+                 (unsigned long long)s.evictions, (unsigned long long)s.writeBacks, pool.residentPages(), pool.capacityPages());
+    if (f != stderr) std::fclose(f);
+}
+
+#else
+
+inline Io *io(const std::string &) { return nullptr; }
+inline void read(Io *, std::size_t) {}
+inline void write(Io *, std::size_t) {}
+inline void sync(Io *) {}
+struct CommandTimer {
+    void done(std::string_view) {}
+};
+inline void report() {}
+
+#endif
+
+} // namespace stats
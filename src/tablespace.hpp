@@ -0,0 +1,345 @@
+#pragma once
+#include <bits/stdc++.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "buffer_pool.hpp"
+#include "durability.hpp"
+#include "wal.hpp"
+
+namespace storage {
+
+constexpr PageId kNullPage = 0; // page 0 is the superblock, never a node
+
+// Something stored in a segment that can rewrite itself more compactly,
+// e.g. a B+ tree left sparse by erasures. Every checkpoint first offers
+// each registered one the chance to.
+class Compactable {
+  public:
+    virtual ~Compactable() = default;
+    virtual void compactIfSparse() = 0;
+};
+
+// Every table and index in one data file of fixed-size pages, paired with
+// one redo log, so the file count stays the same however many indexes the
+// tables grow.
+//
+// Page 0 is the superblock: a magic tag, a format version, the page count,
+// the head of the free page list and a directory of named segments. Each
+// segment has a few root slots (so that a table and its indexes can share
+// it) with the number of records and pages under each, and the unused rest
+// of its current extent. Pages are handed out from the free list first,
+// then from the segment's extent; a segment that runs out takes the next
+// kExtentPages at the end of the file, so its pages stay clustered. Freed
+// pages are chained through their first four bytes. Opening only reads and
+// validates the superblock; everything else is paged in on demand.
+//
+// Pages are cached in the shared buffer pool. The data file only ever holds
+// a checkpointed state: between checkpoints, modified pages stay dirty in
+// the pool and the tables append one small logical record per mutation to
+// the log, tagged with their segment. The records of one command, whatever
+// tables it touches, are followed by a command-end marker (endCommand()),
+// and checkpoints are taken there, between commands. A checkpoint first
+// appends the dirty page images and a commit marker to the log, then writes
+// them in place and truncates the log; on open, committed images are
+// re-applied and the logical records of the whole commands after the last
+// commit are handed back to each segment's table through replay(), while
+// those of a command cut short by a crash or a failed write are dropped;
+// the store then has to be reopened, and is not checkpointed as it closes. Until every segment
+// with records pending has replayed them, checkpoints are held back so the
+// log is not lost.
+class Tablespace : public PageSource {
+  public:
+    static constexpr int kRootSlots = 8;
+    static constexpr int kMaxSegments = 16;
+    static constexpr PageId kExtentPages = 16;
+
+    Tablespace(const std::string &path, const std::string &logPath) : io(stats::io(path)), log(logPath) {
+        fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+        if (fd < 0) throw std::runtime_error("cannot open " + path);
+        recover();
+        char buf[kPageSize];
+        ssize_t n = ::pread(fd, buf, kPageSize, 0);
+        if (n == 0) {
+            // fresh file: start with just the superblock
+            std::memcpy(super.magic, kMagic, sizeof(kMagic));
+            super.version = kVersion;
+            super.pageCount = 1;
+            superDirty = true;
+            return;
+        }
+        if (n != (ssize_t)kPageSize) throw std::runtime_error(path + ": truncated superblock");
+        std::memcpy(&super, buf, sizeof(super));
+        if (std::memcmp(super.magic, kMagic, sizeof(kMagic)) != 0) throw std::runtime_error(path + ": not a bookstore data file");
+        if (super.version != kVersion) throw std::runtime_error(path + ": unsupported format version");
+        if (super.checksum != super.computeChecksum()) throw std::runtime_error(path + ": superblock checksum mismatch");
+    }
+    ~Tablespace() override {
+        // checkpointing after a command that failed part way would write its
+        // half-applied pages; left unterminated in the log, it is dropped on
+        // the next open instead
+        if (!inCommand) try { checkpoint(); } catch (...) {}
+        bufferPool().drop(*this);
+        if (fd >= 0) ::close(fd);
+    }
+
+    void load(PageId id, void *buf) const override {
+        if (::pread(fd, buf, kPageSize, (off_t)id * kPageSize) != (ssize_t)kPageSize)
+            throw std::runtime_error("short page read");
+        stats::read(io, kPageSize);
+    }
+
+    // Directory index of the named segment, adding it if new.
+    int segment(std::string_view name) {
+        if (name.size() >= sizeof(SegmentEntry::name)) throw std::runtime_error("segment name too long");
+        for (std::uint32_t i = 0; i < super.segments; ++i)
+            if (name == super.dir[i].name) return int(i);
+        if (super.segments == kMaxSegments) throw std::runtime_error("too many segments");
+        SegmentEntry &e = super.dir[super.segments];
+        std::memcpy(e.name, name.data(), name.size());
+        superDirty = true;
+        return int(super.segments++);
+    }
+
+    PageRef pin(PageId id) const { return bufferPool().fetch(*this, id); }
+
+    // Allocates a zero-filled page to root slot `slot` of segment seg and
+    // pins it.
+    PageRef allocate(int seg, int slot, PageId &id) {
+        SegmentEntry &e = super.dir[seg];
+        if (super.freeHead != kNullPage) {
+            id = super.freeHead;
+            std::memcpy(&super.freeHead, pin(id).data(), sizeof(PageId));
+            --super.freePages;
+        } else {
+            if (e.extentNext == e.extentEnd) {
+                e.extentNext = super.pageCount;
+                e.extentEnd = super.pageCount += kExtentPages;
+            }
+            id = e.extentNext++;
+        }
+        ++e.pages[slot];
+        superDirty = true;
+        return bufferPool().create(*this, id);
+    }
+
+    // Returns a page of root slot `slot` of segment seg to the free list.
+    void release(int seg, int slot, PageId id) {
+        PageRef p = bufferPool().create(*this, id);
+        std::memcpy(p.data(), &super.freeHead, sizeof(PageId));
+        super.freeHead = id;
+        ++super.freePages;
+        --super.dir[seg].pages[slot];
+        superDirty = true;
+    }
+
+    PageId root(int seg, int slot) const { return super.dir[seg].roots[slot]; }
+    void setRoot(int seg, int slot, PageId id) { super.dir[seg].roots[slot] = id; superDirty = true; }
+
+    // Number of records / pages under a root slot, kept by its tree.
+    std::uint64_t records(int seg, int slot) const { return super.dir[seg].records[slot]; }
+    void addRecords(int seg, int slot, std::int64_t delta) { super.dir[seg].records[slot] += delta; superDirty = true; }
+    std::uint32_t pages(int seg, int slot) const { return super.dir[seg].pages[slot]; }
+
+    std::uint32_t pageCount() const { return super.pageCount; }
+    std::uint32_t freePages() const { return super.freePages; }
+
+    // Records one logical mutation of segment seg; must precede applying it
+    // to the pages.
+    void logOp(int seg, const void *payload, std::uint32_t n) {
+        opBuf.resize(1 + n);
+        opBuf[0] = char(seg);
+        std::memcpy(opBuf.data() + 1, payload, n);
+        log.append(RedoLog::kOp, opBuf.data(), std::uint32_t(opBuf.size()));
+        inCommand = true;
+    }
+
+    // Call before each command: throws if the one before logged records
+    // but never ended, having failed part way.
+    void beginCommand() const {
+        if (inCommand) throw std::runtime_error("an earlier command failed part way; reopen the store");
+    }
+
+    // Ends the current command: the records it logged replay together or
+    // not at all. Then checkpoints if one is due. A no-op for a command that
+    // logged nothing, so read-only commands may call it concurrently.
+    void endCommand() {
+        if (!inCommand) return;
+        log.append(RedoLog::kCommandEnd, nullptr, 0);
+        inCommand = false;
+        maybeCheckpoint();
+    }
+
+    // Feeds the logical records of segment seg that survived the last
+    // checkpoint back to its table; once no segment has any left, folds
+    // them all into the data file.
+    template <class F>
+    void replay(int seg, F &&apply) {
+        auto it = pendingOps.find(seg);
+        if (it != pendingOps.end()) {
+            for (auto &op : it->second) apply(std::string_view(op));
+            pendingOps.erase(it);
+        }
+        if (pendingOps.empty() && log.size()) checkpoint();
+    }
+
+    void attach(Compactable *c) { compactables.push_back(c); }
+    void detach(Compactable *c) { compactables.erase(std::find(compactables.begin(), compactables.end(), c)); }
+
+    // True once enough work has piled up (or the shared pool is holding more
+    // dirty pages than it has room for) that a checkpoint should be taken.
+    bool checkpointDue() const {
+        return log.size() >= kMaxLogBytes || dirtyPages() >= kMaxDirtyPages || (dirtyPages() && bufferPool().overBudget());
+    }
+
+    // Call between commands, or between the steps of a bulk load, which
+    // logs nothing.
+    void maybeCheckpoint() {
+        if (checkpointDue()) checkpoint();
+    }
+
+    void checkpoint() {
+        if (!pendingOps.empty()) return;
+        for (Compactable *c : compactables) c->compactIfSparse();
+        if (!superDirty && !dirtyPages()) {
+            if (log.size()) log.truncate();
+            return;
+        }
+        // pages may summarize appends to other files (the journal behind the
+        // tallies); those reach the disk first
+        durability().syncAll();
+        // images in page order: superblock first, then the dirty pool frames
+        std::vector<std::pair<PageId, const char *>> pages;
+        char head[kPageSize] = {};
+        super.checksum = super.computeChecksum();
+        std::memcpy(head, &super, sizeof(super));
+        pages.emplace_back(0, head);
+        bufferPool().forEachDirty(*this, [&](PageId id, const char *data) { pages.emplace_back(id, data); });
+        std::sort(pages.begin(), pages.end());
+        std::vector<char> image(sizeof(PageId) + kPageSize);
+        for (auto &[id, data] : pages) {
+            std::memcpy(image.data(), &id, sizeof(id));
+            std::memcpy(image.data() + sizeof(id), data, kPageSize);
+            log.append(RedoLog::kPage, image.data(), image.size());
+        }
+        log.append(RedoLog::kCommit, nullptr, 0);
+        log.sync();
+        for (auto &[id, data] : pages) writeThrough(id, data);
+        syncData();
+        log.truncate();
+        superDirty = false;
+        bufferPool().markClean(*this);
+    }
+
+  private:
+    static constexpr char kMagic[8] = {'B', 'K', 'S', 'T', 'O', 'R', 'E', '1'};
+    static constexpr std::uint32_t kVersion = 5;
+    static constexpr std::size_t kMaxDirtyPages = 3072; // 1024 for each of the three tables
+    static constexpr std::uint64_t kMaxLogBytes = 12u << 20;
+
+    struct SegmentEntry {
+        char name[16];
+        PageId roots[kRootSlots];
+        std::uint64_t records[kRootSlots];
+        std::uint32_t pages[kRootSlots];
+        PageId extentNext, extentEnd; // unused pages of the current extent
+    };
+    struct Superblock {
+        char magic[8];
+        std::uint32_t version;
+        std::uint32_t pageCount;
+        PageId freeHead;
+        std::uint32_t freePages;
+        std::uint32_t segments;
+        SegmentEntry dir[kMaxSegments];
+        std::uint32_t checksum; // crc32 of everything above
+
+        std::uint32_t computeChecksum() const { return crc32(this, offsetof(Superblock, checksum)); }
+    };
+    static_assert(sizeof(Superblock) <= kPageSize);
+
+    void writeThrough(PageId id, const void *buf) {
+        if (::pwrite(fd, buf, kPageSize, (off_t)id * kPageSize) != (ssize_t)kPageSize)
+            throw std::runtime_error("short page write");
+        stats::write(io, kPageSize);
+    }
+    void syncData() {
+        ::fdatasync(fd);
+        stats::sync(io);
+    }
+
+    // Re-applies every committed checkpoint found in the log and keeps the
+    // logical records of the whole commands after the last one for replay().
+    void recover() {
+        if (!log.size()) return;
+        std::vector<std::string> images;
+        std::vector<std::string> command; // records of a command not yet seen to end
+        bool applied = false;
+        log.scan([&](RedoLog::Type type, std::string_view payload) {
+            if (type == RedoLog::kOp && !payload.empty()) {
+                command.emplace_back(payload);
+            } else if (type == RedoLog::kCommandEnd) {
+                for (auto &op : command) pendingOps[std::uint8_t(op[0])].emplace_back(op.substr(1));
+                command.clear();
+            } else if (type == RedoLog::kPage && payload.size() == sizeof(PageId) + kPageSize) {
+                images.emplace_back(payload);
+            } else if (type == RedoLog::kCommit) {
+                for (auto &img : images) {
+                    PageId id;
+                    std::memcpy(&id, img.data(), sizeof(id));
+                    writeThrough(id, img.data() + sizeof(id));
+                }
+                images.clear();
+                pendingOps.clear();
+                command.clear();
+                applied = true;
+            }
+        });
+        if (applied) syncData();
+    }
+
+    int fd = -1;
+    stats::Io *io;
+    RedoLog log;
+    Superblock super{};
+    bool superDirty = false;
+    bool inCommand = false; // records logged since the last command end
+    std::map<int, std::vector<std::string>> pendingOps; // by segment, until replayed
+    std::vector<Compactable *> compactables;
+    std::string opBuf;
+};
+
+// A table's named share of a tablespace: root slots for the table and its
+// indexes, and its own stream of log records. The tablespace stays open as
+// long as any of its segments does.
+class Segment {
+  public:
+    Segment(std::shared_ptr<Tablespace> space, std::string_view name) : space(std::move(space)), index(this->space->segment(name)) {}
+
+    PageRef pin(PageId id) const { return space->pin(id); }
+    PageRef pinNew(int slot, PageId &id) { return space->allocate(index, slot, id); }
+    void freePage(int slot, PageId id) { space->release(index, slot, id); }
+
+    PageId root(int slot) const { return space->root(index, slot); }
+    void setRoot(int slot, PageId id) { space->setRoot(index, slot, id); }
+    std::uint64_t records(int slot) const { return space->records(index, slot); }
+    void addRecords(int slot, std::int64_t delta) { space->addRecords(index, slot, delta); }
+    std::uint32_t pages(int slot) const { return space->pages(index, slot); }
+
+    void logOp(const void *payload, std::uint32_t n) { space->logOp(index, payload, n); }
+    template <class F>
+    void replay(F &&apply) { space->replay(index, std::forward<F>(apply)); }
+
+    void attach(Compactable *c) { space->attach(c); }
+    void detach(Compactable *c) { space->detach(c); }
+
+    bool checkpointDue() const { return space->checkpointDue(); }
+    void endCommand() { space->endCommand(); }
+    void maybeCheckpoint() { space->maybeCheckpoint(); }
+    void checkpoint() { space->checkpoint(); }
+
+  private:
+    std::shared_ptr<Tablespace> space;
+    int index;
+};
+
+} // namespace storage
@@ -0,0 +1,111 @@
+#pragma once
+#include <bits/stdc++.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "durability.hpp"
+#include "stats.hpp"
+
+namespace storage {
+
+inline std::uint32_t crc32(const void *data, std::size_t n, std::uint32_t crc = 0) {
+    static const auto table = [] {
+        std::array<std::uint32_t, 256> t{};
+        for (std::uint32_t i = 0; i < 256; ++i) {
+            std::uint32_t c = i;
+            for (int k = 0; k < 8; ++k) c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            t[i] = c;
+        }
+        return t;
+    }();
+    auto p = static_cast<const unsigned char *>(data);
+    crc = ~crc;
+    while (n--) crc = table[(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+    return ~crc;
+}
+
+// Append-only redo log. Every record is framed as
+//   [crc32][payload length][type][payload]
+// where the checksum covers type and payload; a torn or garbled tail fails
+// the check and ends the scan, so partially written records are ignored.
+// Appends reach the OS immediately; when they reach the disk is up to the
+// durability policy, and to checkpoints, which always sync.
+class RedoLog : public Syncable {
+  public:
+    enum Type : std::uint8_t {
+        kOp = 1,     // table-level logical operation
+        kPage = 2,   // full page image written during a checkpoint
+        kCommit = 3, // the page images before it form a complete checkpoint
+        kCommandEnd = 4, // the ops since the previous one form one whole command
+    };
+
+    explicit RedoLog(const std::string &path) : io(stats::io(path)) {
+        fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_APPEND, 0644);
+        if (fd < 0) throw std::runtime_error("cannot open " + path);
+        off_t end = ::lseek(fd, 0, SEEK_END);
+        bytes = synced = end > 0 ? std::uint64_t(end) : 0;
+    }
+    ~RedoLog() override { if (fd >= 0) ::close(fd); }
+
+    RedoLog(const RedoLog &) = delete;
+    RedoLog &operator=(const RedoLog &) = delete;
+
+    void append(Type type, const void *payload, std::uint32_t n) {
+        std::uint8_t frame[kFrame + 256];
+        std::unique_ptr<std::uint8_t[]> big;
+        std::uint8_t *buf = frame;
+        if (n > 256) { big.reset(new std::uint8_t[kFrame + n]); buf = big.get(); }
+        buf[8] = type;
+        std::memcpy(buf + kFrame, payload, n);
+        std::uint32_t crc = crc32(buf + 8, 1 + n);
+        std::memcpy(buf, &crc, 4);
+        std::memcpy(buf + 4, &n, 4);
+        if (::write(fd, buf, kFrame + n) != ssize_t(kFrame + n)) throw std::runtime_error("log write failed");
+        stats::write(io, kFrame + n);
+        bytes += kFrame + n;
+    }
+
+    // Calls visit(type, payload) for each intact record from the start of
+    // the log and returns the offset just past the last one.
+    template <class F>
+    std::uint64_t scan(F &&visit) const {
+        std::uint64_t off = 0;
+        std::vector<std::uint8_t> buf;
+        std::uint8_t head[kFrame];
+        while (::pread(fd, head, kFrame, off_t(off)) == ssize_t(kFrame)) {
+            std::uint32_t crc, n;
+            std::memcpy(&crc, head, 4);
+            std::memcpy(&n, head + 4, 4);
+            if (off + kFrame + n > bytes) break;
+            buf.resize(1 + n);
+            buf[0] = head[8];
+            if (n && ::pread(fd, buf.data() + 1, n, off_t(off + kFrame)) != ssize_t(n)) break;
+            stats::read(io, kFrame + n);
+            if (crc32(buf.data(), 1 + n) != crc) break;
+            visit(Type(head[8]), std::string_view(reinterpret_cast<const char *>(buf.data() + 1), n));
+            off += kFrame + n;
+        }
+        return off;
+    }
+
+    void sync() override {
+        if (synced == bytes) return;
+        ::fdatasync(fd);
+        stats::sync(io);
+        synced = bytes;
+    }
+    void truncate() {
+        if (::ftruncate(fd, 0) != 0) throw std::runtime_error("log truncate failed");
+        bytes = synced = 0;
+    }
+    std::uint64_t size() const { return bytes; }
+
+  private:
+    static constexpr std::size_t kFrame = 9;
+
+    int fd = -1;
+    stats::Io *io;
+    std::uint64_t bytes = 0;
+    std::uint64_t synced = 0; // log size at the last fdatasync
+};
+
+} // namespace storage
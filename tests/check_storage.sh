@@ -0,0 +1,137 @@
+#!/usr/bin/env bash
+# 存储层检查：崩溃恢复、跨重启批量删除账户、快照导出/导入往返
+set -euo pipefail
+ROOT_DIR="$(cd "$(dirname "$0")/.." && pwd)"
+BIN="${BIN:-$ROOT_DIR/code}"
+
+if [[ ! -x "$BIN" ]]; then
+  echo "code 不存在或不可执行，先编译：cmake . && make" >&2
+  exit 1
+fi
+
+WORK="$(mktemp -d)"
+trap 'rm -rf "$WORK"' EXIT
+fail=0
+
+# 在目录 $1 中运行一次程序，标准输入为命令
+run() { (cd "$1" && "$BIN"); }
+
+# 管理员查询：各表的汇总输出
+query() { printf "su root sjtu\nshow\nshow finance\nreport finance\nreport employee\nlog\n" | run "$1"; }
+
+check() {
+  if [[ "$2" == "$3" ]]; then
+    echo "[OK] $1"
+  else
+    echo "[FAIL] $1：期望 $2，实际 $3"
+    fail=1
+  fi
+}
+
+# 重开目录 $2 中的库，核对账本、日志与库存彼此一致
+consistent() {
+  local out shown transactions journaled totals stock
+  out="$(query "$2")"
+  # 账本一侧：show finance 为 "+ 收入 - 支出"，report finance 的 transactions 为交易数
+  shown="$(awk '$1 == "+" && $3 == "-" { print $2, $4; exit }' <<<"$out")"
+  transactions="$(awk '$1 == "transactions" { print $2; exit }' <<<"$out")"
+  # 日志一侧：report employee 的 (total) 行
+  journaled="$(awk '$1 == "(total)" { print $9, $5; exit }' <<<"$out")"
+  check "$1 show finance 与日志汇总一致" "$journaled" "$shown"
+  # 交易数 = 导入次数 + 销售次数；库存 = 导入册数 - 售出册数
+  totals="$(awk '$1 == "(total)" { print $3 + $7, $4 - $8; exit }' <<<"$out")"
+  stock="$(awk -F'\t' 'NF == 6 && $1 ~ /^ISBN-/ { s += $6 } END { print s + 0 }' <<<"$out")"
+  check "$1 交易数与库存与日志一致" "$transactions $stock" "$totals"
+}
+
+# 1. 中途 kill -9 后重开：库存、show finance 与日志汇总应一致
+store="$WORK/crash"; mkdir -p "$store"
+books=200
+{
+  echo "su root sjtu"
+  for ((i = 1; i <= books; i++)); do
+    echo "select ISBN-$i"
+    echo "modify -name=\"book$i\" -price=$((i % 50 + 1)).50"
+    echo "import 1000 $((i * 3)).25"
+  done
+} | run "$store" >/dev/null
+awk -v books="$books" 'BEGIN {
+  srand(1); print "su root sjtu"
+  for (i = 0; i < 400000; i++) {
+    b = int(rand() * books) + 1
+    if (i % 97 == 0) { print "select ISBN-" b; print "import " int(rand() * 5) + 1 " 7.00" }
+    else print "buy ISBN-" b " " int(rand() * 3) + 1
+  }
+}' >"$WORK/workload.txt"
+for round in 1 2 3 4 5; do
+  (cd "$store" && exec "$BIN" <"$WORK/workload.txt" >/dev/null) &
+  pid=$!
+  sleep "0.$((RANDOM % 4 + 1))"
+  kill -9 "$pid" 2>/dev/null || true
+  wait "$pid" 2>/dev/null || true
+  consistent "第 $round 次崩溃后" "$store"
+done
+
+# 2. 命令执行到一半写入失败（超出文件大小限制）：报错退出，重开后半条命令不留痕迹
+store="$WORK/failed"; mkdir -p "$store"
+{
+  echo "su root sjtu"
+  for ((i = 1; i <= 50; i++)); do echo "select ISBN-$i"; echo "modify -price=2.00"; echo "import 100 10"; done
+  for ((i = 0; i < 3000; i++)); do echo "buy ISBN-$((i % 50 + 1)) 1"; done
+} | run "$store" >/dev/null
+# journal.bin 是各文件中最大的，把文件大小限制设在它当前大小之上一点，使某次购买追加 journal.bin 时失败
+limit=$(( $(stat -c %s "$store/.data/journal.bin") / 1024 + 2 ))
+set +e
+(
+  trap '' XFSZ
+  ulimit -f "$limit"
+  cd "$store"
+  { echo "su root sjtu"; for ((i = 0; i < 3000; i++)); do echo "buy ISBN-$((i % 50 + 1)) 1"; done; } | "$BIN" >/dev/null 2>&1
+)
+ret=$?
+set -e
+check "写入失败时报错退出" "1" "$ret"
+consistent "写入失败后" "$store"
+
+# 3. 跨重启批量删除账户：删除的账户不再存在，其余可登录，释放的页被复用
+store="$WORK/accounts"; mkdir -p "$store"
+users=3000
+{
+  echo "su root sjtu"
+  for ((i = 1; i <= users; i++)); do echo "useradd user$i pw$i 1 name$i"; done
+} | run "$store" >/dev/null
+for part in 0 1 2; do
+  {
+    echo "su root sjtu"
+    for ((i = 1; i <= users; i++)); do
+      if (( i % 4 != 0 && i % 3 == part )); then echo "delete user$i"; fi
+    done
+  } | run "$store" >/dev/null
+done
+{
+  for ((i = 1; i <= users; i++)); do echo "su user$i pw$i"; echo "logout"; done
+} | run "$store" >"$WORK/logins.txt"
+invalid="$(grep -c '^Invalid$' "$WORK/logins.txt" || true)"
+thinned="$(stat -c %s "$store/.data/bookstore.db")"
+check "删除的账户登录失败、其余账户登录成功" "$((2 * (users - users / 4)))" "$invalid"
+{
+  echo "su root sjtu"
+  for ((i = 1; i <= users; i++)); do
+    if (( i % 4 != 0 )); then echo "useradd again$i pw$i 1 name$i"; fi
+  done
+} | run "$store" >/dev/null
+grown="$(stat -c %s "$store/.data/bookstore.db")"
+check "重新添加同样多的账户复用释放的页，不增大表空间文件" "$thinned" "$grown"
+
+# 4. 快照导出/导入往返：show / report 的输出应相同
+copy="$WORK/copy"; mkdir -p "$copy"
+(cd "$WORK/crash" && "$BIN" --export "$WORK/store.snap")
+(cd "$copy" && "$BIN" --import "$WORK/store.snap")
+if diff <(query "$WORK/crash") <(query "$copy") >/dev/null; then
+  echo "[OK] 导出/导入往返后输出一致"
+else
+  echo "[FAIL] 导出/导入往返后输出不一致"
+  fail=1
+fi
+
+exit "$fail"